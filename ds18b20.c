@@ -29,6 +29,16 @@
  * every time a temperature conversion is required. However this can result in the
  * cached value becoming inconsistent with the hardware value, so care must be taken.
  *
+ * With CONFIG_TEMP_BUS_LOCK enabled, every multi-step bus transaction (reset, ROM addressing,
+ * function command and data) holds a recursive mutex belonging to the bus, so tasks sharing a
+ * bus cannot interleave their transactions. The mutexes of all CONFIG_TEMP_MAX_BUSES slots are
+ * statically allocated together on first use, and a slot is assigned to each bus as it is first
+ * locked.
+ *
+ * Conversion waits are timed with a one-shot esp_timer. Each of the first CONFIG_TEMP_WAIT_TASKS
+ * tasks to wait is given a slot holding its own timer, created on its first wait and reused by
+ * every later one, so waits allocate nothing after the first.
+ *
  */
 
 #include <stddef.h>
@@ -36,19 +46,20 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include <math.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "driver/gpio.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_log.h"
 
 #include "ds18b20.h"
 #include "owb.h"
 
 static const char *TAG = CONFIG_TEMP_TAG; ///< tag for logging
-static const int T_CONV = 750;            ///< maximum conversion time at 12-bit resolution in milliseconds
+static const int32_t T_CONV_US = 750000;  ///< maximum conversion time at 12-bit resolution in microseconds
 
 // Function commands
 #define DS18B20_FUNCTION_TEMP_CONVERT 0x44      ///< Initiate a single temperature conversion
@@ -59,6 +70,14 @@ static const int T_CONV = 750;            ///< maximum conversion time at 12-bit
 #define DS18B20_FUNCTION_POWER_SUPPLY_READ 0xB4 ///< Determine if a device is using parasitic power
 
 /// @cond ignore
+typedef struct
+{
+    TaskHandle_t task;
+    esp_timer_handle_t timer;
+    SemaphoreHandle_t wake;
+    StaticSemaphore_t wake_buffer;
+} Sleeper;
+
 typedef struct
 {
     uint8_t temperature[2]; // [0] is LSB, [1] is MSB
@@ -70,6 +89,119 @@ typedef struct
 } __attribute__((packed)) Scratchpad;
 /// @endcond ignore
 
+static Sleeper sleepers[CONFIG_TEMP_WAIT_TASKS] = {0};                  ///< conversion timers of the waiting tasks
+static portMUX_TYPE sleepers_spinlock = portMUX_INITIALIZER_UNLOCKED; ///< guards assignment of sleepers
+
+#ifdef CONFIG_TEMP_BUS_LOCK
+/// @cond ignore
+typedef struct
+{
+    const OneWireBus *bus;
+    SemaphoreHandle_t mutex;
+    StaticSemaphore_t mutex_buffer;
+} BusLock;
+/// @endcond ignore
+
+static BusLock bus_locks[CONFIG_TEMP_MAX_BUSES] = {0};            ///< per-bus transaction locks
+static portMUX_TYPE bus_locks_spinlock = portMUX_INITIALIZER_UNLOCKED; ///< guards assignment of bus_locks
+static int bus_locks_state = 0;                                   ///< 0 before the mutexes exist, 1 while they are created, 2 after
+
+static void _bus_locks_create(void)
+{
+    // the mutexes of every slot are created once and never deleted, so a slot handed to another bus
+    // keeps a valid mutex and nothing is created inside the spinlock
+    bool create = false;
+    int state;
+    do
+    {
+        portENTER_CRITICAL(&bus_locks_spinlock);
+        state = bus_locks_state;
+        if (state == 0)
+        {
+            bus_locks_state = 1;
+            create = true;
+        }
+        portEXIT_CRITICAL(&bus_locks_spinlock);
+        if (state == 1)
+        {
+            vTaskDelay(1); // another task is creating them
+        }
+    } while (state == 1);
+
+    if (create)
+    {
+        for (int i = 0; i < CONFIG_TEMP_MAX_BUSES; ++i)
+        {
+            bus_locks[i].mutex = xSemaphoreCreateRecursiveMutexStatic(&bus_locks[i].mutex_buffer);
+        }
+        portENTER_CRITICAL(&bus_locks_spinlock);
+        bus_locks_state = 2;
+        portEXIT_CRITICAL(&bus_locks_spinlock);
+    }
+}
+
+static SemaphoreHandle_t _bus_mutex(const OneWireBus *bus, bool assign)
+{
+    SemaphoreHandle_t mutex = NULL;
+    BusLock *free_lock = NULL;
+    _bus_locks_create();
+    portENTER_CRITICAL(&bus_locks_spinlock);
+    for (int i = 0; i < CONFIG_TEMP_MAX_BUSES && mutex == NULL; ++i)
+    {
+        if (bus_locks[i].bus == bus)
+        {
+            mutex = bus_locks[i].mutex;
+        }
+        else if (bus_locks[i].bus == NULL && free_lock == NULL)
+        {
+            free_lock = &bus_locks[i]; // released slots leave holes, so keep looking for this bus
+        }
+    }
+    if (mutex == NULL && free_lock != NULL && assign)
+    {
+        // first use of this bus
+        free_lock->bus = bus;
+        mutex = free_lock->mutex;
+    }
+    portEXIT_CRITICAL(&bus_locks_spinlock);
+    if (mutex == NULL)
+    {
+        if (assign)
+        {
+            ESP_LOGE(TAG, "no free bus lock of %d, bus %p is not locked; release the locks of buses no longer in use",
+                     CONFIG_TEMP_MAX_BUSES, bus);
+        }
+        else
+        {
+            ESP_LOGE(TAG, "bus %p has no lock to unlock", bus);
+        }
+    }
+    return mutex;
+}
+#endif
+
+static void _bus_lock(const OneWireBus *bus)
+{
+#ifdef CONFIG_TEMP_BUS_LOCK
+    SemaphoreHandle_t mutex = _bus_mutex(bus, true);
+    if (mutex != NULL)
+    {
+        xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    }
+#endif
+}
+
+static void _bus_unlock(const OneWireBus *bus)
+{
+#ifdef CONFIG_TEMP_BUS_LOCK
+    SemaphoreHandle_t mutex = _bus_mutex(bus, false);
+    if (mutex != NULL)
+    {
+        xSemaphoreGiveRecursive(mutex);
+    }
+#endif
+}
+
 static void _init(DS18B20_Info *ds18b20_info, const OneWireBus *bus)
 {
     if (ds18b20_info != NULL)
@@ -79,6 +211,20 @@ static void _init(DS18B20_Info *ds18b20_info, const OneWireBus *bus)
         ds18b20_info->use_crc = false;
         ds18b20_info->resolution = DS18B20_RESOLUTION_INVALID;
         ds18b20_info->solo = false; // assume multiple devices unless told otherwise
+        ds18b20_info->overtime_percent = CONFIG_TEMP_CONVERSION_OVERTIME;
+#if defined(CONFIG_TEMP_TIMEOUT_POLICY_RETRY)
+        ds18b20_info->timeout_policy = DS18B20_TIMEOUT_RETRY;
+#elif defined(CONFIG_TEMP_TIMEOUT_POLICY_FAIL)
+        ds18b20_info->timeout_policy = DS18B20_TIMEOUT_FAIL;
+#else
+        ds18b20_info->timeout_policy = DS18B20_TIMEOUT_IGNORE;
+#endif
+        ds18b20_info->timeout_retries = CONFIG_TEMP_CONVERSION_RETRIES;
+        ds18b20_info->power_mode = DS18B20_POWER_UNKNOWN;
+        ds18b20_info->calibration.offset = 0;
+        ds18b20_info->calibration.gain = DS18B20_CALIBRATION_GAIN_ONE;
+        ds18b20_info->verify = true;
+        memset(&ds18b20_info->cache, 0, sizeof(ds18b20_info->cache));
         ds18b20_info->init = true;
     }
     else
@@ -144,70 +290,148 @@ static bool _check_resolution(DS18B20_RESOLUTION resolution)
     return (resolution >= DS18B20_RESOLUTION_9_BIT) && (resolution <= DS18B20_RESOLUTION_12_BIT);
 }
 
+static int64_t _conversion_us(DS18B20_RESOLUTION resolution)
+{
+    return T_CONV_US >> (DS18B20_RESOLUTION_12_BIT - resolution);
+}
+
+static void _wake(void *arg)
+{
+    xSemaphoreGive((SemaphoreHandle_t)arg);
+}
+
+static Sleeper *_sleeper(void)
+{
+    // a slot stays with its task, keyed by handle, so a task is only ever woken by its own timer.
+    // the task that claims a slot is the only one to use it, so the timer is created outside the spinlock
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    Sleeper *sleeper = NULL;
+    Sleeper *free_sleeper = NULL;
+    portENTER_CRITICAL(&sleepers_spinlock);
+    for (int i = 0; i < CONFIG_TEMP_WAIT_TASKS && sleeper == NULL; ++i)
+    {
+        if (sleepers[i].task == task)
+        {
+            sleeper = &sleepers[i];
+        }
+        else if (sleepers[i].task == NULL && free_sleeper == NULL)
+        {
+            free_sleeper = &sleepers[i];
+        }
+    }
+    if (sleeper == NULL && free_sleeper != NULL)
+    {
+        free_sleeper->task = task;
+    }
+    portEXIT_CRITICAL(&sleepers_spinlock);
+
+    if (sleeper == NULL && free_sleeper != NULL)
+    {
+        // first wait of this task
+        sleeper = free_sleeper;
+        sleeper->wake = xSemaphoreCreateBinaryStatic(&sleeper->wake_buffer);
+        esp_timer_create_args_t args = {
+            .callback = _wake,
+            .arg = sleeper->wake,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "ds18b20",
+        };
+        if (esp_timer_create(&args, &sleeper->timer) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "no timer available, waits are rounded up to the tick");
+            sleeper->timer = NULL;
+        }
+    }
+    else if (sleeper == NULL)
+    {
+        ESP_LOGD(TAG, "no free conversion timer of %d, waits are rounded up to the tick", CONFIG_TEMP_WAIT_TASKS);
+    }
+    return sleeper;
+}
+
+static void _sleep_until(int64_t time_us)
+{
+    // a one-shot timer wakes the task at the exact time, whatever the tick rate
+    int64_t remaining_us = time_us - esp_timer_get_time();
+    if (remaining_us <= 0)
+    {
+        return;
+    }
+    Sleeper *sleeper = _sleeper();
+    if (sleeper != NULL && sleeper->timer != NULL && esp_timer_start_once(sleeper->timer, remaining_us) == ESP_OK)
+    {
+        xSemaphoreTake(sleeper->wake, portMAX_DELAY);
+    }
+    else
+    {
+        // round up to whole ticks, using the tick rate as the period is 0 ms above 1 kHz
+        vTaskDelay((remaining_us * configTICK_RATE_HZ + 999999) / 1000000);
+    }
+}
+
 static float _wait_for_duration(DS18B20_RESOLUTION resolution)
 {
     int64_t start_time = esp_timer_get_time();
     if (_check_resolution(resolution))
     {
-        int divisor = 1 << (DS18B20_RESOLUTION_12_BIT - resolution);
-        ESP_LOGD(TAG, "divisor %d", divisor);
-        float max_conversion_time = (float)T_CONV / (float)divisor;
-        int ticks = ceil(max_conversion_time / portTICK_PERIOD_MS);
-        ESP_LOGD(TAG, "wait for conversion: %.3f ms, %d ticks", max_conversion_time, ticks);
+        int64_t max_conversion_us = _conversion_us(resolution);
+        ESP_LOGD(TAG, "wait for conversion: %lld us", max_conversion_us);
 
         // wait at least this maximum conversion time
-        vTaskDelay(ticks);
+        _sleep_until(start_time + max_conversion_us);
     }
     int64_t end_time = esp_timer_get_time();
-    return (float)(end_time - start_time) / 1000000.0f;
+    return (float)(end_time - start_time) / 1000.0f;
 }
 
-static float _wait_for_device_signal(const DS18B20_Info *ds18b20_info)
+static DS18B20_ERROR _wait_for_device_signal(const DS18B20_Info *ds18b20_info, float *elapsed_time)
 {
-    float elapsed_time = 0.0f;
+    DS18B20_ERROR err = DS18B20_OK;
+    *elapsed_time = 0.0f;
     if (_check_resolution(ds18b20_info->resolution))
     {
-        int divisor = 1 << (DS18B20_RESOLUTION_12_BIT - ds18b20_info->resolution);
-
-        // allow for 10% overtime
-        float max_conversion_time = (float)T_CONV / (float)divisor * 1.1;
-        int max_conversion_ticks = ceil(max_conversion_time / portTICK_PERIOD_MS);
-        ESP_LOGD(TAG, "wait for conversion: max %.0f ms, %d ticks", max_conversion_time, max_conversion_ticks);
+        // allow for the configured overtime
+        int64_t max_conversion_us = ds18b20_conversion_time_us(ds18b20_info);
+        ESP_LOGD(TAG, "wait for conversion: max %lld us", max_conversion_us);
 
         // wait for conversion to complete - all devices will pull bus low once complete
-        TickType_t start_ticks = xTaskGetTickCount();
-        TickType_t duration_ticks = 0;
+        int64_t start_us = esp_timer_get_time();
+        int64_t deadline_us = start_us + max_conversion_us;
+        int64_t now_us = start_us;
         uint8_t status = 0;
         do
         {
-            vTaskDelay(1);
+            int64_t poll_us = now_us + CONFIG_TEMP_CONVERSION_POLL_INTERVAL;
+            _sleep_until(poll_us < deadline_us ? poll_us : deadline_us);
+            _bus_lock(ds18b20_info->bus);
             owb_read_bit(ds18b20_info->bus, &status);
-            duration_ticks = xTaskGetTickCount() - start_ticks;
-        } while (status == 0 && duration_ticks < max_conversion_ticks);
+            _bus_unlock(ds18b20_info->bus);
+            now_us = esp_timer_get_time();
+        } while (status == 0 && now_us < deadline_us);
 
-        elapsed_time = duration_ticks * portTICK_PERIOD_MS;
-        if (duration_ticks >= max_conversion_ticks)
+        *elapsed_time = (now_us - start_us) / 1000.0f;
+        if (status == 0)
         {
-            ESP_LOGW(TAG, "conversion timed out");
+            ESP_LOGW(TAG, "conversion timed out after %.3f ms", *elapsed_time);
+            err = DS18B20_ERROR_TIMEOUT;
         }
         else
         {
-            ESP_LOGD(TAG, "conversion took at most %.0f ms", elapsed_time);
+            ESP_LOGD(TAG, "conversion took at most %.3f ms", *elapsed_time);
         }
     }
-    return elapsed_time;
+    return err;
 }
 
-static float _decode_temp(uint8_t lsb, uint8_t msb, DS18B20_RESOLUTION resolution)
+static int16_t _decode_raw(uint8_t lsb, uint8_t msb, DS18B20_RESOLUTION resolution)
 {
-    float result = 0.0f;
+    int16_t result = 0;
     if (_check_resolution(resolution))
     {
         // masks to remove undefined bits from result
         static const uint8_t lsb_mask[4] = {~0x07, ~0x03, ~0x01, ~0x00};
         uint8_t lsb_masked = lsb_mask[resolution - DS18B20_RESOLUTION_9_BIT] & lsb;
-        int16_t raw = (msb << 8) | lsb_masked;
-        result = raw / 16.0f;
+        result = (int16_t)((msb << 8) | lsb_masked);
     }
     else
     {
@@ -216,6 +440,24 @@ static float _decode_temp(uint8_t lsb, uint8_t msb, DS18B20_RESOLUTION resolutio
     return result;
 }
 
+static int16_t _calibrate(int16_t raw, const DS18B20_Calibration *calibration)
+{
+    if (calibration->gain == DS18B20_CALIBRATION_GAIN_ONE && calibration->offset == 0)
+    {
+        return raw;
+    }
+    // Q11.4 * Q2.14 is Q13.18, round to nearest and shift back to Q11.4
+    int32_t value = (int32_t)raw * calibration->gain;
+    value = (value + (1 << 13)) >> 14;
+    value += calibration->offset;
+    return value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : (int16_t)value;
+}
+
+static float _decode_temp(int16_t raw)
+{
+    return raw / 16.0f;
+}
+
 static size_t _min(size_t x, size_t y)
 {
     return x > y ? y : x;
@@ -240,6 +482,7 @@ static DS18B20_ERROR _read_scratchpad(const DS18B20_Info *ds18b20_info, Scratchp
     count = _min(sizeof(Scratchpad), count); // avoid reading past end of scratchpad
 
     ESP_LOGD(TAG, "scratchpad read: CRC %d, count %d", ds18b20_info->use_crc, count);
+    _bus_lock(ds18b20_info->bus);
     if (_address_device(ds18b20_info))
     {
         // read scratchpad
@@ -287,6 +530,7 @@ static DS18B20_ERROR _read_scratchpad(const DS18B20_Info *ds18b20_info, Scratchp
     {
         err = DS18B20_ERROR_DEVICE;
     }
+    _bus_unlock(ds18b20_info->bus);
     return err;
 }
 
@@ -297,6 +541,7 @@ static bool _write_scratchpad(const DS18B20_Info *ds18b20_info, const Scratchpad
     // All three bytes MUST be written before the next reset to avoid corruption.
     if (_is_init(ds18b20_info))
     {
+        _bus_lock(ds18b20_info->bus);
         if (_address_device(ds18b20_info))
         {
             ESP_LOGD(TAG, "scratchpad write 3 bytes:");
@@ -327,10 +572,72 @@ static bool _write_scratchpad(const DS18B20_Info *ds18b20_info, const Scratchpad
                 }
             }
         }
+        _bus_unlock(ds18b20_info->bus);
     }
     return result;
 }
 
+static void _cache_scratchpad(DS18B20_Info *ds18b20_info, const Scratchpad *scratchpad)
+{
+    ds18b20_info->cache.trigger_high = scratchpad->trigger_high;
+    ds18b20_info->cache.trigger_low = scratchpad->trigger_low;
+    ds18b20_info->cache.configuration = scratchpad->configuration;
+    ds18b20_info->cache.valid = true;
+}
+
+static DS18B20_ERROR _read_config(DS18B20_Info *ds18b20_info, Scratchpad *scratchpad)
+{
+    DS18B20_ERROR err = DS18B20_OK;
+    if (ds18b20_info->cache.valid)
+    {
+        scratchpad->trigger_high = ds18b20_info->cache.trigger_high;
+        scratchpad->trigger_low = ds18b20_info->cache.trigger_low;
+        scratchpad->configuration = ds18b20_info->cache.configuration;
+    }
+    else
+    {
+        // read scratchpad up to and including configuration register
+        err = _read_scratchpad(ds18b20_info, scratchpad,
+                               offsetof(Scratchpad, configuration) - offsetof(Scratchpad, temperature) + 1);
+        // only a CRC-checked read is trusted to skip later writes or to supply the triggers written back
+        if (err == DS18B20_OK && ds18b20_info->use_crc)
+        {
+            _cache_scratchpad(ds18b20_info, scratchpad);
+        }
+    }
+    return err;
+}
+
+static uint8_t _resolution_config(DS18B20_RESOLUTION resolution)
+{
+    return (((resolution - 1) & 0x03) << 5) | 0x1f;
+}
+
+static DS18B20_ERROR _apply_scratchpad(DS18B20_Info *ds18b20_info, const Scratchpad *target)
+{
+    // the caller holds the bus lock and has filled the cache, so an unchanged configuration costs no bus time
+    if (ds18b20_info->cache.valid && ds18b20_info->cache.trigger_high == target->trigger_high &&
+        ds18b20_info->cache.trigger_low == target->trigger_low &&
+        ds18b20_info->cache.configuration == target->configuration)
+    {
+        ESP_LOGD(TAG, "configuration already applied");
+        return DS18B20_OK;
+    }
+
+    DS18B20_ERROR err = DS18B20_ERROR_DEVICE;
+    if (_write_scratchpad(ds18b20_info, target, ds18b20_info->verify))
+    {
+        _cache_scratchpad(ds18b20_info, target);
+        err = DS18B20_OK;
+    }
+    else
+    {
+        // the device may hold the old or the new registers, so read them again next time
+        ds18b20_info->cache.valid = false;
+    }
+    return err;
+}
+
 // Public API
 
 DS18B20_Info *ds18b20_malloc(void)
@@ -401,25 +708,49 @@ void ds18b20_use_crc(DS18B20_Info *ds18b20_info, bool use_crc)
     }
 }
 
+void ds18b20_use_verify(DS18B20_Info *ds18b20_info, bool verify)
+{
+    if (_is_init(ds18b20_info))
+    {
+        ds18b20_info->verify = verify;
+        ESP_LOGD(TAG, "verify %d", ds18b20_info->verify);
+    }
+}
+
+void ds18b20_invalidate_cache(DS18B20_Info *ds18b20_info)
+{
+    if (_is_init(ds18b20_info))
+    {
+        ds18b20_info->cache.valid = false;
+    }
+}
+
 bool ds18b20_set_resolution(DS18B20_Info *ds18b20_info, DS18B20_RESOLUTION resolution)
 {
     bool result = false;
     if (_is_init(ds18b20_info))
     {
-        if (_check_resolution(ds18b20_info->resolution))
+        if (_check_resolution(resolution))
         {
-            // read scratchpad up to and including configuration register
+            // the read-modify-write must not interleave with another task's scratchpad write
+            _bus_lock(ds18b20_info->bus);
+
+            // read the alarm triggers and configuration, from the cache if it is valid
             Scratchpad scratchpad = {0};
-            _read_scratchpad(ds18b20_info, &scratchpad,
-                             offsetof(Scratchpad, configuration) - offsetof(Scratchpad, temperature) + 1);
+            if (_read_config(ds18b20_info, &scratchpad) != DS18B20_OK)
+            {
+                // writing now would clear the alarm triggers
+                ESP_LOGE(TAG, "configuration not read, keeping resolution %d", ds18b20_info->resolution);
+                _bus_unlock(ds18b20_info->bus);
+                return false;
+            }
 
             // modify configuration register to set resolution
-            uint8_t value = (((resolution - 1) & 0x03) << 5) | 0x1f;
-            scratchpad.configuration = value;
-            ESP_LOGD(TAG, "configuration value 0x%02x", value);
+            scratchpad.configuration = _resolution_config(resolution);
+            ESP_LOGD(TAG, "configuration value 0x%02x", scratchpad.configuration);
 
-            // write bytes 2, 3 and 4 of scratchpad
-            result = _write_scratchpad(ds18b20_info, &scratchpad, /* verify */ true);
+            // write bytes 2, 3 and 4 of scratchpad, unless they are already set
+            result = _apply_scratchpad(ds18b20_info, &scratchpad) == DS18B20_OK;
             if (result)
             {
                 ds18b20_info->resolution = resolution;
@@ -431,6 +762,7 @@ bool ds18b20_set_resolution(DS18B20_Info *ds18b20_info, DS18B20_RESOLUTION resol
                 ds18b20_info->resolution = ds18b20_read_resolution(ds18b20_info);
                 ESP_LOGW(TAG, "Resolution consistency lost - refreshed from device: %d", ds18b20_info->resolution);
             }
+            _bus_unlock(ds18b20_info->bus);
         }
         else
         {
@@ -440,15 +772,55 @@ bool ds18b20_set_resolution(DS18B20_Info *ds18b20_info, DS18B20_RESOLUTION resol
     return result;
 }
 
+DS18B20_ERROR ds18b20_apply_config(DS18B20_Info *ds18b20_info, const DS18B20_Config *config)
+{
+    DS18B20_ERROR err = DS18B20_ERROR_UNKNOWN;
+    if (_is_init(ds18b20_info))
+    {
+        if (config == NULL)
+        {
+            ESP_LOGE(TAG, "config is NULL");
+            return DS18B20_ERROR_NULL;
+        }
+        if (!_check_resolution(config->resolution) || config->trigger_low > config->trigger_high)
+        {
+            ESP_LOGE(TAG, "invalid config: resolution %d, triggers %d to %d", config->resolution,
+                     config->trigger_low, config->trigger_high);
+            return DS18B20_ERROR_PARAM;
+        }
+
+        _bus_lock(ds18b20_info->bus);
+        Scratchpad scratchpad = {0};
+        if ((err = _read_config(ds18b20_info, &scratchpad)) == DS18B20_OK)
+        {
+            scratchpad.trigger_high = (uint8_t)config->trigger_high;
+            scratchpad.trigger_low = (uint8_t)config->trigger_low;
+            scratchpad.configuration = _resolution_config(config->resolution);
+            if ((err = _apply_scratchpad(ds18b20_info, &scratchpad)) == DS18B20_OK)
+            {
+                ds18b20_info->resolution = config->resolution;
+            }
+            else
+            {
+                ESP_LOGE(TAG, "config not applied, keeping resolution %d", ds18b20_info->resolution);
+            }
+        }
+        _bus_unlock(ds18b20_info->bus);
+    }
+    return err;
+}
+
 DS18B20_RESOLUTION ds18b20_read_resolution(DS18B20_Info *ds18b20_info)
 {
     DS18B20_RESOLUTION resolution = DS18B20_RESOLUTION_INVALID;
     if (_is_init(ds18b20_info))
     {
-        // read scratchpad up to and including configuration register
         Scratchpad scratchpad = {0};
-        _read_scratchpad(ds18b20_info, &scratchpad,
-                         offsetof(Scratchpad, configuration) - offsetof(Scratchpad, temperature) + 1);
+        if (_read_config(ds18b20_info, &scratchpad) != DS18B20_OK)
+        {
+            ESP_LOGE(TAG, "cannot read resolution from device");
+            return DS18B20_RESOLUTION_INVALID;
+        }
 
         resolution = ((scratchpad.configuration >> 5) & 0x03) + DS18B20_RESOLUTION_9_BIT;
         if (!_check_resolution(resolution))
@@ -470,16 +842,22 @@ bool ds18b20_convert(const DS18B20_Info *ds18b20_info)
     if (_is_init(ds18b20_info))
     {
         const OneWireBus *bus = ds18b20_info->bus;
+        _bus_lock(bus);
         if (_address_device(ds18b20_info))
         {
             // initiate a temperature measurement
             owb_write_byte(bus, DS18B20_FUNCTION_TEMP_CONVERT);
+            if (ds18b20_is_parasitic(ds18b20_info))
+            {
+                owb_set_strong_pullup(bus, true);
+            }
             result = true;
         }
         else
         {
             ESP_LOGE(TAG, "ds18b20 device not responding");
         }
+        _bus_unlock(bus);
     }
     return result;
 }
@@ -489,10 +867,12 @@ void ds18b20_convert_all(const OneWireBus *bus)
     if (bus)
     {
         bool is_present = false;
+        _bus_lock(bus);
         owb_reset(bus, &is_present);
         owb_write_byte(bus, OWB_ROM_SKIP);
         owb_write_byte(bus, DS18B20_FUNCTION_TEMP_CONVERT);
         owb_set_strong_pullup(bus, true);
+        _bus_unlock(bus);
     }
     else
     {
@@ -500,27 +880,76 @@ void ds18b20_convert_all(const OneWireBus *bus)
     }
 }
 
-float ds18b20_wait_for_conversion(const DS18B20_Info *ds18b20_info)
+DS18B20_ERROR ds18b20_wait_for_conversion_status(const DS18B20_Info *ds18b20_info, float *elapsed_time)
 {
-    float elapsed_time = 0.0f;
+    DS18B20_ERROR err = DS18B20_ERROR_UNKNOWN;
+    float elapsed = 0.0f;
     if (_is_init(ds18b20_info))
     {
-        if (ds18b20_info->bus->use_parasitic_power)
+        if (ds18b20_is_parasitic(ds18b20_info))
         {
             // in parasitic mode, devices cannot signal when they are complete,
             // so use the datasheet values to wait for a duration.
-            elapsed_time = _wait_for_duration(ds18b20_info->resolution);
+            elapsed = _wait_for_duration(ds18b20_info->resolution);
+            err = DS18B20_OK;
         }
         else
         {
             // wait for the device(s) to indicate the conversion is complete
-            elapsed_time = _wait_for_device_signal(ds18b20_info);
+            err = _wait_for_device_signal(ds18b20_info, &elapsed);
         }
     }
+    if (elapsed_time)
+    {
+        *elapsed_time = elapsed;
+    }
+    return err;
+}
+
+float ds18b20_wait_for_conversion(const DS18B20_Info *ds18b20_info)
+{
+    float elapsed_time = 0.0f;
+    ds18b20_wait_for_conversion_status(ds18b20_info, &elapsed_time);
     return elapsed_time;
 }
 
-DS18B20_ERROR ds18b20_read_temp(const DS18B20_Info *ds18b20_info, float *value)
+int64_t ds18b20_conversion_time_us(const DS18B20_Info *ds18b20_info)
+{
+    int64_t conversion_us = T_CONV_US;
+    if (_is_init(ds18b20_info))
+    {
+        if (_check_resolution(ds18b20_info->resolution))
+        {
+            conversion_us = _conversion_us(ds18b20_info->resolution);
+        }
+        conversion_us += conversion_us * ds18b20_info->overtime_percent / 100;
+    }
+    return conversion_us;
+}
+
+void ds18b20_set_timeout_policy(DS18B20_Info *ds18b20_info, uint16_t overtime_percent,
+                                DS18B20_TIMEOUT_POLICY policy, uint8_t retries)
+{
+    if (_is_init(ds18b20_info))
+    {
+        ds18b20_info->overtime_percent = overtime_percent;
+        ds18b20_info->timeout_policy = policy;
+        ds18b20_info->timeout_retries = retries;
+        ESP_LOGD(TAG, "timeout policy %d, overtime %u%%, retries %u", policy, overtime_percent, retries);
+    }
+}
+
+void ds18b20_set_calibration(DS18B20_Info *ds18b20_info, const DS18B20_Calibration *calibration)
+{
+    if (_is_init(ds18b20_info))
+    {
+        ds18b20_info->calibration.offset = calibration ? calibration->offset : 0;
+        ds18b20_info->calibration.gain = calibration ? calibration->gain : DS18B20_CALIBRATION_GAIN_ONE;
+        ESP_LOGD(TAG, "calibration offset %d, gain %d", ds18b20_info->calibration.offset, ds18b20_info->calibration.gain);
+    }
+}
+
+DS18B20_ERROR ds18b20_read_temp_raw(const DS18B20_Info *ds18b20_info, int16_t *value)
 {
     DS18B20_ERROR err = DS18B20_ERROR_UNKNOWN;
     if (_is_init(ds18b20_info))
@@ -538,34 +967,111 @@ DS18B20_ERROR ds18b20_read_temp(const DS18B20_Info *ds18b20_info, float *value)
         if (scratchpad.reserved[1] == 0x0c && temp_MSB == 0x05 && temp_LSB == 0x50)
         {
             ESP_LOGE(TAG, "Read power-on value (85.0)");
-            err = DS18B20_ERROR_DEVICE;
+            err = DS18B20_ERROR_POWER_ON;
+        }
+        if (err == DS18B20_ERROR_CRC || err == DS18B20_ERROR_DEVICE || err == DS18B20_ERROR_POWER_ON)
+        {
+            // the device may have been reset to its eeprom configuration. the cache only mirrors
+            // the device, so it is bookkeeping rather than part of the const device info
+            ((DS18B20_Info *)ds18b20_info)->cache.valid = false;
         }
 
-        float temp = _decode_temp(temp_LSB, temp_MSB, ds18b20_info->resolution);
-        ESP_LOGD(TAG, "temp_LSB 0x%02x, temp_MSB 0x%02x, temp %f", temp_LSB, temp_MSB, temp);
+        // failed reads keep the error placeholder or power-on value recognisable
+        int16_t raw = _decode_raw(temp_LSB, temp_MSB, ds18b20_info->resolution);
+        if (err == DS18B20_OK)
+        {
+            raw = _calibrate(raw, &ds18b20_info->calibration);
+        }
+        ESP_LOGD(TAG, "temp_LSB 0x%02x, temp_MSB 0x%02x, raw %d", temp_LSB, temp_MSB, raw);
 
         if (value)
         {
-            *value = temp;
+            *value = raw;
         }
     }
     return err;
 }
 
+int32_t ds18b20_convert_units(int16_t raw, DS18B20_UNIT unit)
+{
+    // 1/16 degree steps are 6.25 centidegrees and 62.5 millidegrees, so scale by the reduced
+    // fraction and add half the divisor before the arithmetic right shift to round
+    int32_t value = raw;
+    switch (unit)
+    {
+    case DS18B20_UNIT_CENTI_C:
+        value = (value * 25 + 2) >> 2; // 100 / 16 = 25 / 4
+        break;
+    case DS18B20_UNIT_MILLI_C:
+        value = (value * 125 + 1) >> 1; // 1000 / 16 = 125 / 2
+        break;
+    case DS18B20_UNIT_CENTI_F:
+        value = ((value * 45 + 2) >> 2) + 3200; // 100 * 9 / 5 / 16 = 45 / 4, plus 32 degrees
+        break;
+    case DS18B20_UNIT_SIXTEENTH_C:
+    default:
+        break;
+    }
+    return value;
+}
+
+DS18B20_ERROR ds18b20_read_temp_units(const DS18B20_Info *ds18b20_info, DS18B20_UNIT unit, int32_t *value)
+{
+    int16_t raw = 0;
+    DS18B20_ERROR err = ds18b20_read_temp_raw(ds18b20_info, &raw);
+    if (err != DS18B20_ERROR_UNKNOWN && value)
+    {
+        *value = ds18b20_convert_units(raw, unit);
+    }
+    return err;
+}
+
+DS18B20_ERROR ds18b20_read_temp(const DS18B20_Info *ds18b20_info, float *value)
+{
+    int16_t raw = 0;
+    DS18B20_ERROR err = ds18b20_read_temp_raw(ds18b20_info, &raw);
+    if (err != DS18B20_ERROR_UNKNOWN && value)
+    {
+        // raw value is only left unset if the device info is not initialised
+        *value = _decode_temp(raw);
+        ESP_LOGD(TAG, "temp %f", *value);
+    }
+    return err;
+}
+
 DS18B20_ERROR ds18b20_convert_and_read_temp(const DS18B20_Info *ds18b20_info, float *value)
 {
     DS18B20_ERROR err = DS18B20_ERROR_UNKNOWN;
     if (_is_init(ds18b20_info))
     {
-        if (ds18b20_convert(ds18b20_info))
+        int attempts = 0;
+        DS18B20_ERROR wait_err = DS18B20_ERROR_UNKNOWN;
+        bool converted = false;
+        do
         {
-            // wait at least maximum conversion time
-            ds18b20_wait_for_conversion(ds18b20_info);
+            converted = ds18b20_convert(ds18b20_info);
+            if (converted)
+            {
+                // wait at least maximum conversion time
+                wait_err = ds18b20_wait_for_conversion_status(ds18b20_info, NULL);
+            }
+        } while (converted && wait_err == DS18B20_ERROR_TIMEOUT &&
+                 ds18b20_info->timeout_policy == DS18B20_TIMEOUT_RETRY &&
+                 attempts++ < ds18b20_info->timeout_retries);
 
+        if (converted)
+        {
             if (value)
             {
                 *value = 0.0f;
                 err = ds18b20_read_temp(ds18b20_info, value);
+
+                // the value may be a previous conversion, so make that visible to the caller
+                if (err == DS18B20_OK && wait_err == DS18B20_ERROR_TIMEOUT &&
+                    ds18b20_info->timeout_policy != DS18B20_TIMEOUT_IGNORE)
+                {
+                    err = DS18B20_ERROR_TIMEOUT;
+                }
             }
             else
             {
@@ -583,6 +1089,7 @@ DS18B20_ERROR ds18b20_check_for_parasite_power(const OneWireBus *bus, bool *pres
     if (bus)
     {
         bool reset_present;
+        _bus_lock(bus);
         if ((err = owb_reset(bus, &reset_present)) == DS18B20_OK)
         {
             ESP_LOGD(TAG, "owb_reset OK");
@@ -605,6 +1112,7 @@ DS18B20_ERROR ds18b20_check_for_parasite_power(const OneWireBus *bus, bool *pres
                 }
             }
         }
+        _bus_unlock(bus);
     }
     else
     {
@@ -613,3 +1121,120 @@ DS18B20_ERROR ds18b20_check_for_parasite_power(const OneWireBus *bus, bool *pres
     }
     return err;
 }
+
+DS18B20_ERROR ds18b20_read_power_supply(DS18B20_Info *ds18b20_info, DS18B20_POWER_MODE *power_mode)
+{
+    DS18B20_ERROR err = DS18B20_ERROR_UNKNOWN;
+    if (_is_init(ds18b20_info))
+    {
+        const OneWireBus *bus = ds18b20_info->bus;
+        _bus_lock(bus);
+        if (_address_device(ds18b20_info))
+        {
+            // the addressed device pulls the bus low during the read time slot if it is parasitic
+            uint8_t value = 0;
+            if (owb_write_byte(bus, DS18B20_FUNCTION_POWER_SUPPLY_READ) == OWB_STATUS_OK &&
+                owb_read_bit(bus, &value) == OWB_STATUS_OK)
+            {
+                ds18b20_info->power_mode = (value & 0x01u) ? DS18B20_POWER_EXTERNAL : DS18B20_POWER_PARASITIC;
+                ESP_LOGD(TAG, "power supply %s", (value & 0x01u) ? "external" : "parasitic");
+                err = DS18B20_OK;
+            }
+            else
+            {
+                err = DS18B20_ERROR_OWB;
+            }
+        }
+        else
+        {
+            err = DS18B20_ERROR_DEVICE;
+        }
+        _bus_unlock(bus);
+        if (power_mode)
+        {
+            *power_mode = ds18b20_info->power_mode;
+        }
+    }
+    return err;
+}
+
+bool ds18b20_is_parasitic(const DS18B20_Info *ds18b20_info)
+{
+    // devices that have not been checked follow the bus-wide setting
+    return ds18b20_info != NULL && (ds18b20_info->power_mode == DS18B20_POWER_PARASITIC ||
+                                    (ds18b20_info->power_mode == DS18B20_POWER_UNKNOWN &&
+                                     ds18b20_info->bus != NULL && ds18b20_info->bus->use_parasitic_power));
+}
+
+void ds18b20_sleep_until(int64_t time_us)
+{
+    _sleep_until(time_us);
+}
+
+void ds18b20_bus_lock(const OneWireBus *bus)
+{
+    if (bus)
+    {
+        _bus_lock(bus);
+    }
+    else
+    {
+        ESP_LOGE(TAG, "bus is NULL");
+    }
+}
+
+void ds18b20_bus_unlock(const OneWireBus *bus)
+{
+    if (bus)
+    {
+        _bus_unlock(bus);
+    }
+    else
+    {
+        ESP_LOGE(TAG, "bus is NULL");
+    }
+}
+
+DS18B20_ERROR ds18b20_bus_lock_release(const OneWireBus *bus)
+{
+    DS18B20_ERROR err = DS18B20_OK;
+#ifdef CONFIG_TEMP_BUS_LOCK
+    if (bus == NULL)
+    {
+        ESP_LOGE(TAG, "bus is NULL");
+        return DS18B20_ERROR_NULL;
+    }
+    portENTER_CRITICAL(&bus_locks_spinlock);
+    for (int i = 0; i < CONFIG_TEMP_MAX_BUSES; ++i)
+    {
+        if (bus_locks[i].bus == bus)
+        {
+            if (xSemaphoreGetMutexHolder(bus_locks[i].mutex) != NULL)
+            {
+                // a task is inside a transaction and would lose its unlock
+                err = DS18B20_ERROR_BUSY;
+            }
+            else
+            {
+                // the mutex stays created, the slot is simply reused by the next bus
+                bus_locks[i].bus = NULL;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&bus_locks_spinlock);
+    if (err != DS18B20_OK)
+    {
+        ESP_LOGE(TAG, "bus %p is locked, its lock is not released", bus);
+    }
+#endif
+    return err;
+}
+
+size_t ds18b20_static_size(void)
+{
+    size_t size = sizeof(sleepers) + sizeof(sleepers_spinlock);
+#ifdef CONFIG_TEMP_BUS_LOCK
+    size += sizeof(bus_locks) + sizeof(bus_locks_spinlock) + sizeof(bus_locks_state);
+#endif
+    return size;
+}
@@ -0,0 +1,496 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_arbiter.c
+ *
+ * Pending requests are held in a small array and the next one is chosen by a linear scan for the
+ * highest priority and earliest submission. The queue is expected to hold a handful of requests,
+ * for which a scan is cheaper than maintaining a heap.
+ *
+ * For externally powered devices the bus is released once a conversion has been started. Until the
+ * conversion is due, only reads of a higher priority than the conversion are served, so a control
+ * read submitted during a bulk sweep waits for at most one read, and requests submitted after the
+ * conversion still see its result. Parasitic devices need the strong pull-up for the whole
+ * conversion, so their conversions hold the bus until they complete.
+ *
+ * Any traffic after the convert command ends the devices' completion signal, so a conversion that
+ * released the bus is purely timed: it completes with DS18B20_OK once the datasheet time plus the
+ * device's overtime has passed, measured with an esp_timer rather than ticks. A timeout cannot be
+ * detected this way, so the read that follows is what reports bad data: the power-on value as an
+ * error, and a read of a device that is still converting as DS18B20_ERROR_TIMEOUT, as its value is
+ * from the previous conversion.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "ds18b20_arbiter.h"
+
+#ifdef CONFIG_TEMP_ARBITER
+
+static const char *TAG = CONFIG_TEMP_TAG; ///< tag for logging
+
+static bool _before(const DS18B20_Request *a, const DS18B20_Request *b)
+{
+    return a->priority > b->priority || (a->priority == b->priority && (int32_t)(a->order - b->order) < 0);
+}
+
+static bool _compatible(const DS18B20_Request *lead, const DS18B20_Request *other)
+{
+    bool compatible = false;
+    switch (lead->type)
+    {
+    case DS18B20_REQUEST_CONVERT_ALL:
+        // a convert-all starts a conversion on every device, so addressed converts ride along
+        compatible = other->type == DS18B20_REQUEST_CONVERT_ALL || other->type == DS18B20_REQUEST_CONVERT;
+        break;
+    case DS18B20_REQUEST_CONVERT:
+    case DS18B20_REQUEST_READ:
+        compatible = other->type == lead->type && other->device == lead->device;
+        break;
+    default:
+        break;
+    }
+    return compatible;
+}
+
+static void _remove(DS18B20_Arbiter *arbiter, int index)
+{
+    --arbiter->count;
+    memmove(&arbiter->pending[index], &arbiter->pending[index + 1], (arbiter->count - index) * sizeof(arbiter->pending[0]));
+}
+
+static bool _servable(const DS18B20_Arbiter *arbiter, const DS18B20_Request *request)
+{
+    // while a conversion is in progress only reads that preempt it may use the bus
+    return arbiter->converting_count == 0 ||
+           (request->type == DS18B20_REQUEST_READ && request->priority > arbiter->converting[0]->priority);
+}
+
+/**
+ * Remove the next request that may be served now and all requests that can be merged with it
+ * from the queue. Returns the number of requests placed in batch, the first being the one chosen.
+ */
+static int _take_batch(DS18B20_Arbiter *arbiter, DS18B20_Request **batch)
+{
+    int count = 0;
+    xSemaphoreTake(arbiter->mutex, portMAX_DELAY);
+    int next = -1;
+    for (int i = 0; i < arbiter->count; ++i)
+    {
+        if (_servable(arbiter, arbiter->pending[i]) && (next < 0 || _before(arbiter->pending[i], arbiter->pending[next])))
+        {
+            next = i;
+        }
+    }
+    if (next >= 0)
+    {
+        batch[count++] = arbiter->pending[next];
+        _remove(arbiter, next);
+
+        for (int i = 0; i < arbiter->count;)
+        {
+            if (_compatible(batch[0], arbiter->pending[i]))
+            {
+                batch[count++] = arbiter->pending[i];
+                _remove(arbiter, i);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+    xSemaphoreGive(arbiter->mutex);
+    return count;
+}
+
+static void _complete(DS18B20_Request *request)
+{
+    // the request belongs to the caller again once it is woken, so read it first
+    TaskHandle_t waiter = request->waiter;
+    if (waiter != NULL)
+    {
+        xTaskNotifyGive(waiter);
+    }
+    else if (request->callback != NULL)
+    {
+        request->callback(request, request->arg);
+    }
+}
+
+static void _complete_batch(DS18B20_Request **batch, int count, DS18B20_ERROR result, int16_t value)
+{
+    ESP_LOGD(TAG, "request type %d priority %d served with %d merged, result %d", batch[0]->type, batch[0]->priority,
+             count - 1, result);
+    for (int i = 0; i < count; ++i)
+    {
+        batch[i]->result = result;
+        batch[i]->value = value;
+        _complete(batch[i]);
+    }
+}
+
+static bool _holds_bus(const DS18B20_Arbiter *arbiter, const DS18B20_Request *lead)
+{
+    // the strong pull-up must power parasitic devices until their conversion ends
+    if (lead->type == DS18B20_REQUEST_CONVERT_ALL)
+    {
+        return arbiter->bus->use_parasitic_power;
+    }
+    return lead->device->power_mode == DS18B20_POWER_PARASITIC ||
+           (lead->device->power_mode == DS18B20_POWER_UNKNOWN && arbiter->bus->use_parasitic_power);
+}
+
+/**
+ * Keep a started conversion until it is due, releasing the bus meanwhile. The wait is the worst-case
+ * conversion time, as the devices cannot signal completion once other requests have used the bus.
+ */
+static void _defer_conversion(DS18B20_Arbiter *arbiter, DS18B20_Request **batch, int count,
+                              const DS18B20_Info *timing, int64_t started_us)
+{
+    memcpy(arbiter->converting, batch, count * sizeof(batch[0]));
+    arbiter->converting_count = count;
+    arbiter->converting_ready_us = started_us + ds18b20_conversion_time_us(timing);
+}
+
+/**
+ * Complete a deferred conversion once its worst-case conversion time has passed.
+ */
+static void _finish_conversion(DS18B20_Arbiter *arbiter)
+{
+    int count = arbiter->converting_count;
+    arbiter->converting_count = 0;
+    _complete_batch(arbiter->converting, count, DS18B20_OK, 0);
+}
+
+static bool _converting(const DS18B20_Arbiter *arbiter, const DS18B20_Info *device)
+{
+    for (int i = 0; i < arbiter->converting_count; ++i)
+    {
+        if (arbiter->converting[i]->type == DS18B20_REQUEST_CONVERT_ALL || arbiter->converting[i]->device == device)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void _execute(DS18B20_Arbiter *arbiter, DS18B20_Request **batch, int count)
+{
+    DS18B20_Request *lead = batch[0];
+    DS18B20_ERROR result = DS18B20_ERROR_UNKNOWN;
+    int16_t value = 0;
+
+    ds18b20_bus_lock(arbiter->bus);
+    switch (lead->type)
+    {
+    case DS18B20_REQUEST_CONVERT_ALL:
+    {
+        // wait long enough for the slowest device of any merged request
+        const DS18B20_Info *timing = lead->device;
+        for (int i = 1; i < count; ++i)
+        {
+            if (batch[i]->device->resolution > timing->resolution)
+            {
+                timing = batch[i]->device;
+            }
+        }
+        int64_t started_us = esp_timer_get_time();
+        ds18b20_convert_all(arbiter->bus);
+        if (!_holds_bus(arbiter, lead))
+        {
+            ds18b20_bus_unlock(arbiter->bus);
+            _defer_conversion(arbiter, batch, count, timing, started_us);
+            return;
+        }
+        result = ds18b20_wait_for_conversion_status(timing, NULL);
+        break;
+    }
+    case DS18B20_REQUEST_CONVERT:
+    {
+        int64_t started_us = esp_timer_get_time();
+        if (!ds18b20_convert(lead->device))
+        {
+            result = DS18B20_ERROR_DEVICE;
+        }
+        else if (!_holds_bus(arbiter, lead))
+        {
+            ds18b20_bus_unlock(arbiter->bus);
+            _defer_conversion(arbiter, batch, count, lead->device, started_us);
+            return;
+        }
+        else
+        {
+            result = ds18b20_wait_for_conversion_status(lead->device, NULL);
+        }
+        break;
+    }
+    case DS18B20_REQUEST_READ:
+        result = ds18b20_read_temp_raw(lead->device, &value);
+        if (result == DS18B20_OK && _converting(arbiter, lead->device))
+        {
+            // a read preempting the device's own conversion returns the previous result
+            result = DS18B20_ERROR_TIMEOUT;
+        }
+        break;
+    case DS18B20_REQUEST_SET_RESOLUTION:
+        result = ds18b20_set_resolution(lead->device, lead->resolution) ? DS18B20_OK : DS18B20_ERROR_DEVICE;
+        break;
+    default:
+        ESP_LOGE(TAG, "unknown request type %d", lead->type);
+        break;
+    }
+    ds18b20_bus_unlock(arbiter->bus);
+
+    _complete_batch(batch, count, result, value);
+}
+
+static void _wake(void *arg)
+{
+    xTaskNotifyGive(((DS18B20_Arbiter *)arg)->task);
+}
+
+static TickType_t _wait_until(DS18B20_Arbiter *arbiter, int64_t time_us)
+{
+    // a one-shot timer notifies the task at the exact time, whatever the tick rate
+    int64_t remaining_us = time_us - esp_timer_get_time();
+    if (remaining_us <= 0)
+    {
+        return 0;
+    }
+    if (arbiter->timer != NULL)
+    {
+        esp_timer_stop(arbiter->timer);
+        if (esp_timer_start_once(arbiter->timer, remaining_us) == ESP_OK)
+        {
+            return portMAX_DELAY;
+        }
+    }
+    // round up, so the task wakes once the time has passed
+    return (remaining_us * configTICK_RATE_HZ + 999999) / 1000000;
+}
+
+static void _arbiter_task(void *arg)
+{
+    DS18B20_Arbiter *arbiter = (DS18B20_Arbiter *)arg;
+    DS18B20_Request *batch[DS18B20_ARBITER_QUEUE_LENGTH];
+
+    while (!arbiter->stop)
+    {
+        if (arbiter->converting_count > 0 && esp_timer_get_time() >= arbiter->converting_ready_us)
+        {
+            _finish_conversion(arbiter);
+            continue;
+        }
+        int count = _take_batch(arbiter, batch);
+        if (count > 0)
+        {
+            _execute(arbiter, batch, count);
+        }
+        else
+        {
+            // submissions notify the task, so a submit racing with this check is not lost
+            ulTaskNotifyTake(pdTRUE, arbiter->converting_count > 0 ? _wait_until(arbiter, arbiter->converting_ready_us)
+                                                                    : portMAX_DELAY);
+        }
+    }
+    if (arbiter->timer != NULL)
+    {
+        esp_timer_stop(arbiter->timer);
+        esp_timer_delete(arbiter->timer);
+    }
+    if (arbiter->converting_count > 0)
+    {
+        _finish_conversion(arbiter);
+    }
+
+    xSemaphoreTake(arbiter->mutex, portMAX_DELAY);
+    int count = arbiter->count;
+    memcpy(batch, arbiter->pending, count * sizeof(batch[0]));
+    arbiter->count = 0;
+    xSemaphoreGive(arbiter->mutex);
+    for (int i = 0; i < count; ++i)
+    {
+        batch[i]->result = DS18B20_ERROR_UNKNOWN;
+        _complete(batch[i]);
+    }
+
+    xTaskNotifyGive(arbiter->stopper);
+    vTaskDelete(NULL);
+}
+
+static DS18B20_ERROR _submit(DS18B20_Arbiter *arbiter, DS18B20_Request *request)
+{
+    if (arbiter == NULL || request == NULL || request->device == NULL)
+    {
+        ESP_LOGE(TAG, "arbiter, request or device is NULL");
+        return DS18B20_ERROR_NULL;
+    }
+    if (request->type > DS18B20_REQUEST_SET_RESOLUTION)
+    {
+        ESP_LOGE(TAG, "unknown request type %d", request->type);
+        return DS18B20_ERROR_PARAM;
+    }
+    if (request->device->bus != arbiter->bus)
+    {
+        ESP_LOGE(TAG, "device is not on the arbiter's bus");
+        return DS18B20_ERROR_PARAM;
+    }
+
+    DS18B20_ERROR err = DS18B20_OK;
+    xSemaphoreTake(arbiter->mutex, portMAX_DELAY);
+    if (arbiter->stop || arbiter->count >= DS18B20_ARBITER_QUEUE_LENGTH)
+    {
+        ESP_LOGE(TAG, "arbiter queue full or stopping");
+        err = DS18B20_ERROR_UNKNOWN;
+    }
+    else
+    {
+        request->result = DS18B20_ERROR_UNKNOWN;
+        request->order = arbiter->next_order++;
+        arbiter->pending[arbiter->count++] = request;
+    }
+    xSemaphoreGive(arbiter->mutex);
+
+    if (err == DS18B20_OK)
+    {
+        xTaskNotifyGive(arbiter->task);
+    }
+    return err;
+}
+
+// Public API
+
+DS18B20_Arbiter *ds18b20_arbiter_malloc(const OneWireBus *bus, UBaseType_t task_priority)
+{
+    if (bus == NULL)
+    {
+        ESP_LOGE(TAG, "bus is NULL");
+        return NULL;
+    }
+
+    DS18B20_Arbiter *arbiter = malloc(sizeof(*arbiter));
+    if (arbiter != NULL)
+    {
+        memset(arbiter, 0, sizeof(*arbiter));
+        arbiter->bus = bus;
+        arbiter->mutex = xSemaphoreCreateMutex();
+        esp_timer_create_args_t args = {
+            .callback = _wake,
+            .arg = arbiter,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "ds18b20_arbiter",
+        };
+        if (esp_timer_create(&args, &arbiter->timer) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "no timer available, conversion waits are rounded up to the tick");
+            arbiter->timer = NULL;
+        }
+        if (arbiter->mutex == NULL ||
+            xTaskCreate(_arbiter_task, "ds18b20_arbiter", CONFIG_TEMP_ARBITER_STACK_SIZE, arbiter, task_priority,
+                        &arbiter->task) != pdPASS)
+        {
+            ESP_LOGE(TAG, "arbiter task create failed");
+            if (arbiter->mutex != NULL)
+            {
+                vSemaphoreDelete(arbiter->mutex);
+            }
+            if (arbiter->timer != NULL)
+            {
+                esp_timer_delete(arbiter->timer);
+            }
+            free(arbiter);
+            arbiter = NULL;
+        }
+        else
+        {
+            ESP_LOGD(TAG, "arbiter malloc %p for bus %p", arbiter, bus);
+        }
+    }
+    else
+    {
+        ESP_LOGE(TAG, "malloc failed");
+    }
+    return arbiter;
+}
+
+void ds18b20_arbiter_free(DS18B20_Arbiter **arbiter)
+{
+    if (arbiter != NULL && (*arbiter != NULL))
+    {
+        DS18B20_Arbiter *instance = *arbiter;
+        ESP_LOGD(TAG, "arbiter free %p", instance);
+
+        xSemaphoreTake(instance->mutex, portMAX_DELAY);
+        instance->stopper = xTaskGetCurrentTaskHandle();
+        instance->stop = true;
+        xSemaphoreGive(instance->mutex);
+        xTaskNotifyGive(instance->task);
+
+        // the task finishes its current transaction and fails the rest before it exits
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        vSemaphoreDelete(instance->mutex);
+        free(instance);
+        *arbiter = NULL;
+    }
+}
+
+DS18B20_ERROR ds18b20_arbiter_submit(DS18B20_Arbiter *arbiter, DS18B20_Request *request)
+{
+    if (request != NULL)
+    {
+        request->waiter = NULL;
+    }
+    return _submit(arbiter, request);
+}
+
+DS18B20_ERROR ds18b20_arbiter_execute(DS18B20_Arbiter *arbiter, DS18B20_Request *request)
+{
+    if (request != NULL)
+    {
+        request->waiter = xTaskGetCurrentTaskHandle();
+    }
+    DS18B20_ERROR err = _submit(arbiter, request);
+    if (err == DS18B20_OK)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        err = request->result;
+    }
+    return err;
+}
+
+#endif // CONFIG_TEMP_ARBITER
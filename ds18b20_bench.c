@@ -0,0 +1,302 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_bench.c
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "ds18b20_bench.h"
+#ifdef CONFIG_TEMP_SIM
+#include "ds18b20_sim.h"
+#endif
+
+#ifdef CONFIG_TEMP_BENCH
+
+static const char *TAG = CONFIG_TEMP_TAG; ///< tag for logging
+
+static int64_t _esp_clock(void *arg)
+{
+    return esp_timer_get_time();
+}
+
+static int _find_devices(OneWireBus *bus, DS18B20_Info *devices, const DS18B20_BenchCase *bench_case)
+{
+    int count = 0;
+    OneWireBus_SearchState search_state = {0};
+    bool found = false;
+    owb_search_first(bus, &search_state, &found);
+    while (found && count < bench_case->device_count)
+    {
+        ds18b20_init(&devices[count], bus, search_state.rom_code);
+        ++count;
+        owb_search_next(bus, &search_state, &found);
+    }
+    if (count == 1)
+    {
+        // a lone device is addressed with skip ROM, as the wrapper does
+        devices[0].solo = true;
+    }
+
+    bool parasitic = false;
+    for (int i = 0; i < count; ++i)
+    {
+        DS18B20_POWER_MODE power_mode = DS18B20_POWER_UNKNOWN;
+        ds18b20_read_power_supply(&devices[i], &power_mode);
+        parasitic |= power_mode == DS18B20_POWER_PARASITIC;
+        ds18b20_use_crc(&devices[i], bench_case->use_crc);
+        ds18b20_set_resolution(&devices[i], bench_case->resolution);
+    }
+    owb_use_parasitic_power(bus, parasitic);
+    return count;
+}
+
+DS18B20_ERROR ds18b20_bench_run(OneWireBus *const *buses, const DS18B20_BenchCase *bench_case, int sweeps,
+                                DS18B20_BenchClock clock, void *clock_arg, DS18B20_BenchResult *result)
+{
+    if (buses == NULL || bench_case == NULL || result == NULL)
+    {
+        ESP_LOGE(TAG, "buses, case or result is NULL");
+        return DS18B20_ERROR_NULL;
+    }
+    if (sweeps <= 0 || bench_case->device_count <= 0 || bench_case->bus_count <= 0 ||
+        bench_case->bus_count > DS18B20_BENCH_MAX_BUSES)
+    {
+        ESP_LOGE(TAG, "invalid benchmark case");
+        return DS18B20_ERROR_PARAM;
+    }
+    if (clock == NULL)
+    {
+        clock = _esp_clock;
+    }
+    memset(result, 0, sizeof(*result));
+    result->bench_case = *bench_case;
+
+    DS18B20_Info *devices = calloc(bench_case->bus_count * bench_case->device_count, sizeof(*devices));
+    if (devices == NULL)
+    {
+        ESP_LOGE(TAG, "no memory for %d devices", bench_case->bus_count * bench_case->device_count);
+        return DS18B20_ERROR_UNKNOWN;
+    }
+    int first[DS18B20_BENCH_MAX_BUSES + 1] = {0}; // devices of bus b are first[b] to first[b + 1] - 1
+    for (int b = 0; b < bench_case->bus_count; ++b)
+    {
+        first[b + 1] = first[b] + _find_devices(buses[b], &devices[first[b]], bench_case);
+    }
+    result->device_count = first[bench_case->bus_count];
+
+    int64_t sweep_total_us = 0;
+    int64_t latency_total_us = 0;
+    int64_t started_us[DS18B20_BENCH_MAX_BUSES] = {0};
+    for (int s = 0; s < sweeps; ++s)
+    {
+        int64_t start = clock(clock_arg);
+        // start every bus before waiting on any, so the conversions overlap
+        for (int b = 0; b < bench_case->bus_count; ++b)
+        {
+            started_us[b] = esp_timer_get_time();
+            ds18b20_convert_all(buses[b]);
+        }
+        for (int b = 0; b < bench_case->bus_count; ++b)
+        {
+            if (first[b] == first[b + 1])
+            {
+                continue;
+            }
+            const DS18B20_Info *device = &devices[first[b]];
+            if (buses[b]->use_parasitic_power)
+            {
+                // a fixed wait from this bus's own start, so the waits of several buses do not add up
+                ds18b20_sleep_until(started_us[b] + ds18b20_conversion_time_us(device));
+            }
+            else
+            {
+                ds18b20_wait_for_conversion_status(device, NULL);
+            }
+        }
+        for (int i = 0; i < result->device_count; ++i)
+        {
+            int16_t raw = 0;
+            if (ds18b20_read_temp_raw(&devices[i], &raw) != DS18B20_OK)
+            {
+                ++result->errors;
+            }
+            int32_t latency_us = clock(clock_arg) - start;
+            latency_total_us += latency_us;
+            if (latency_us > result->latency_max_us)
+            {
+                result->latency_max_us = latency_us;
+            }
+        }
+        sweep_total_us += clock(clock_arg) - start;
+        ++result->sweeps;
+    }
+
+    result->sweep_us = sweep_total_us / sweeps;
+    result->sweeps_per_second = sweep_total_us > 0 ? sweeps * 1000000.0f / sweep_total_us : 0.0f;
+    if (result->device_count > 0)
+    {
+        result->latency_mean_us = latency_total_us / ((int64_t)sweeps * result->device_count);
+    }
+    free(devices);
+
+    if (result->device_count < bench_case->bus_count * bench_case->device_count)
+    {
+        ESP_LOGW(TAG, "found %d of %d devices", result->device_count,
+                 bench_case->bus_count * bench_case->device_count);
+        return DS18B20_ERROR_DEVICE;
+    }
+    return DS18B20_OK;
+}
+
+void ds18b20_bench_print_header(void)
+{
+    printf("| devices | buses | bits | crc | power     | sweeps/s | sweep us | latency us | max us   | errors |\n");
+    printf("|--------:|------:|-----:|:---:|:----------|---------:|---------:|-----------:|---------:|-------:|\n");
+}
+
+void ds18b20_bench_print(const DS18B20_BenchResult *result)
+{
+    const DS18B20_BenchCase *bench_case = &result->bench_case;
+    printf("| %7d | %5d | %4d | %-3s | %-9s | %8.2f | %8d | %10d | %8d | %6d |\n",
+           bench_case->device_count, bench_case->bus_count, bench_case->resolution,
+           bench_case->use_crc ? "on" : "off", bench_case->parasitic ? "parasitic" : "external",
+           result->sweeps_per_second, (int)result->sweep_us, (int)result->latency_mean_us,
+           (int)result->latency_max_us, result->errors);
+}
+
+#ifdef CONFIG_TEMP_SIM
+
+/**
+ * @brief Simulated buses of one case, and the clock that counts their bus time.
+ */
+typedef struct
+{
+    int count;          ///< Number of buses
+    DS18B20_Sim sims[]; ///< The simulated buses, count of them
+} SimBench;
+
+static int64_t _sim_clock(void *arg)
+{
+    // the buses are driven one after another from one task, so each one's slot time adds
+    const SimBench *bench = arg;
+    int64_t now_us = esp_timer_get_time();
+    for (int b = 0; b < bench->count; ++b)
+    {
+        now_us += bench->sims[b].slot_time_us;
+    }
+    return now_us;
+}
+
+DS18B20_ERROR ds18b20_bench_sim(const DS18B20_BenchCase *bench_case, int sweeps, DS18B20_BenchResult *result)
+{
+    if (bench_case == NULL || result == NULL)
+    {
+        ESP_LOGE(TAG, "case or result is NULL");
+        return DS18B20_ERROR_NULL;
+    }
+    memset(result, 0, sizeof(*result));
+    if (bench_case->device_count > DS18B20_SIM_MAX_DEVICES || bench_case->bus_count <= 0 ||
+        bench_case->bus_count > DS18B20_BENCH_MAX_BUSES)
+    {
+        ESP_LOGE(TAG, "invalid simulated benchmark case");
+        return DS18B20_ERROR_PARAM;
+    }
+    // only the buses of the case are allocated, as each holds DS18B20_SIM_MAX_DEVICES devices
+    SimBench *bench = malloc(sizeof(*bench) + bench_case->bus_count * sizeof(bench->sims[0]));
+    if (bench == NULL)
+    {
+        ESP_LOGE(TAG, "no memory for %d simulated buses", bench_case->bus_count);
+        return DS18B20_ERROR_UNKNOWN;
+    }
+    OneWireBus *buses[DS18B20_BENCH_MAX_BUSES];
+    bench->count = bench_case->bus_count;
+    for (int b = 0; b < bench->count; ++b)
+    {
+        buses[b] = ds18b20_sim_initialize(&bench->sims[b], b + 1);
+        for (int i = 0; i < bench_case->device_count; ++i)
+        {
+            uint64_t serial = (uint64_t)(b + 1) << 32 | (i + 1);
+            ds18b20_sim_add_device(&bench->sims[b], ds18b20_sim_rom_code(serial), bench_case->parasitic,
+                                   (20 << 4) + i);
+        }
+    }
+    DS18B20_ERROR err = ds18b20_bench_run(buses, bench_case, sweeps, _sim_clock, bench, result);
+    for (int b = 0; b < bench->count; ++b)
+    {
+        ds18b20_bus_lock_release(buses[b]);
+    }
+    free(bench);
+    return err;
+}
+
+int ds18b20_bench_matrix(int sweeps)
+{
+    static const int BUS_COUNTS[] = {1, 2, 4};
+    int failed = 0;
+    ds18b20_bench_print_header();
+    for (int b = 0; b < sizeof(BUS_COUNTS) / sizeof(BUS_COUNTS[0]) && BUS_COUNTS[b] <= DS18B20_BENCH_MAX_BUSES; ++b)
+    {
+        for (int device_count = 1; device_count <= DS18B20_SIM_MAX_DEVICES; device_count *= 4)
+        {
+            for (int parasitic = 0; parasitic <= 1; ++parasitic)
+            {
+                for (int use_crc = 0; use_crc <= 1; ++use_crc)
+                {
+                    for (int resolution = DS18B20_RESOLUTION_9_BIT; resolution <= DS18B20_RESOLUTION_12_BIT; ++resolution)
+                    {
+                        DS18B20_BenchCase bench_case = {
+                            .device_count = device_count,
+                            .bus_count = BUS_COUNTS[b],
+                            .resolution = resolution,
+                            .use_crc = use_crc,
+                            .parasitic = parasitic,
+                        };
+                        DS18B20_BenchResult result;
+                        if (ds18b20_bench_sim(&bench_case, sweeps, &result) != DS18B20_OK || result.errors > 0)
+                        {
+                            ++failed;
+                        }
+                        ds18b20_bench_print(&result);
+                    }
+                }
+            }
+        }
+    }
+    return failed;
+}
+
+#endif // CONFIG_TEMP_SIM
+
+#endif // CONFIG_TEMP_BENCH
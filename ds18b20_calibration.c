@@ -0,0 +1,218 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_calibration.c
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_system.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+#include "ds18b20_calibration.h"
+
+#ifdef CONFIG_TEMP_CALIBRATION
+
+static const char *TAG = CONFIG_TEMP_TAG; ///< tag for logging
+
+#define CALIBRATION_NAMESPACE "ds18b20"                      ///< nvs namespace of the store
+#define CALIBRATION_KEY "calibration"                        ///< nvs key of the blob
+#define CALIBRATION_MAX_ENTRIES (CONFIG_TEMP_CALIBRATION_MAX) ///< most devices in the store
+
+/// @cond ignore
+typedef struct
+{
+    uint8_t rom_code[8];
+    int16_t offset;
+    int16_t gain;
+} __attribute__((packed)) CalibrationEntry;
+/// @endcond ignore
+
+static CalibrationEntry *_load_table(nvs_handle_t handle, int *count)
+{
+    // the table goes on the heap, as CONFIG_TEMP_CALIBRATION_MAX entries may not fit the caller's
+    // stack, with room for the entry ds18b20_calibration_save may add
+    size_t length = 0;
+    esp_err_t err = nvs_get_blob(handle, CALIBRATION_KEY, NULL, &length);
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        length = 0;
+    }
+    else if (err != ESP_OK || length % sizeof(CalibrationEntry) != 0 ||
+             length > CALIBRATION_MAX_ENTRIES * sizeof(CalibrationEntry))
+    {
+        ESP_LOGE(TAG, "calibration store unreadable: %d", err);
+        return NULL;
+    }
+    CalibrationEntry *table = malloc(length + sizeof(*table));
+    if (table == NULL)
+    {
+        ESP_LOGE(TAG, "cannot allocate calibration table");
+        return NULL;
+    }
+    if (length > 0 && (err = nvs_get_blob(handle, CALIBRATION_KEY, table, &length)) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "calibration store unreadable: %d", err);
+        free(table);
+        return NULL;
+    }
+    *count = length / sizeof(*table);
+    return table;
+}
+
+static int _find(const CalibrationEntry *table, int count, OneWireBus_ROMCode rom_code)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        if (memcmp(table[i].rom_code, rom_code.bytes, sizeof(table[i].rom_code)) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool _apply(const CalibrationEntry *table, int count, DS18B20_Info *ds18b20_info)
+{
+    int index = _find(table, count, ds18b20_info->rom_code);
+    if (index < 0)
+    {
+        return false;
+    }
+    DS18B20_Calibration calibration = {.offset = table[index].offset, .gain = table[index].gain};
+    ds18b20_set_calibration(ds18b20_info, &calibration);
+    return true;
+}
+
+// Public API
+
+DS18B20_ERROR ds18b20_calibration_load(DS18B20_Info *ds18b20_info)
+{
+    if (ds18b20_info == NULL || !ds18b20_info->init)
+    {
+        return DS18B20_ERROR_NULL;
+    }
+    int applied = 0;
+    DS18B20_ERROR err = ds18b20_calibration_load_all(&ds18b20_info, 1, &applied);
+    return err == DS18B20_OK && applied == 0 ? DS18B20_ERROR_DEVICE : err;
+}
+
+DS18B20_ERROR ds18b20_calibration_load_all(DS18B20_Info *const *devices, int count, int *applied)
+{
+    if (devices == NULL || applied == NULL)
+    {
+        return DS18B20_ERROR_NULL;
+    }
+    *applied = 0;
+
+    nvs_handle_t handle;
+    if (nvs_open(CALIBRATION_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        // nothing has been stored yet
+        return DS18B20_OK;
+    }
+    int entries = 0;
+    CalibrationEntry *table = _load_table(handle, &entries);
+    nvs_close(handle);
+    if (table == NULL)
+    {
+        return DS18B20_ERROR_STORAGE;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (devices[i] != NULL && devices[i]->init && _apply(table, entries, devices[i]))
+        {
+            ++*applied;
+        }
+    }
+    free(table);
+    return DS18B20_OK;
+}
+
+DS18B20_ERROR ds18b20_calibration_save(const DS18B20_Info *ds18b20_info)
+{
+    if (ds18b20_info == NULL || !ds18b20_info->init)
+    {
+        return DS18B20_ERROR_NULL;
+    }
+
+    nvs_handle_t handle;
+    if (nvs_open(CALIBRATION_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "calibration store cannot be opened");
+        return DS18B20_ERROR_STORAGE;
+    }
+    int count = 0;
+    CalibrationEntry *table = _load_table(handle, &count);
+    if (table == NULL)
+    {
+        nvs_close(handle);
+        return DS18B20_ERROR_STORAGE;
+    }
+
+    const DS18B20_Calibration *calibration = &ds18b20_info->calibration;
+    bool identity = calibration->gain == DS18B20_CALIBRATION_GAIN_ONE && calibration->offset == 0;
+    int index = _find(table, count, ds18b20_info->rom_code);
+    if (identity && index >= 0)
+    {
+        table[index] = table[--count];
+    }
+    else if (!identity)
+    {
+        if (index < 0)
+        {
+            if (count == CALIBRATION_MAX_ENTRIES)
+            {
+                ESP_LOGE(TAG, "calibration store full");
+                free(table);
+                nvs_close(handle);
+                return DS18B20_ERROR_STORAGE;
+            }
+            index = count++;
+            memcpy(table[index].rom_code, ds18b20_info->rom_code.bytes, sizeof(table[index].rom_code));
+        }
+        table[index].offset = calibration->offset;
+        table[index].gain = calibration->gain;
+    }
+
+    DS18B20_ERROR err = DS18B20_OK;
+    if (nvs_set_blob(handle, CALIBRATION_KEY, table, count * sizeof(*table)) != ESP_OK ||
+        nvs_commit(handle) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "calibration store cannot be written");
+        err = DS18B20_ERROR_STORAGE;
+    }
+    free(table);
+    nvs_close(handle);
+    return err;
+}
+
+#endif // CONFIG_TEMP_CALIBRATION
@@ -0,0 +1,161 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_diagnostics.c
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_system.h"
+#include "esp_log.h"
+
+#include "ds18b20_diagnostics.h"
+
+#ifdef CONFIG_TEMP_DIAGNOSTICS
+
+static const char *TAG = CONFIG_TEMP_TAG; ///< tag for logging
+
+static void _count(DS18B20_DiagnosticsWindow *window, uint8_t faults, int direction)
+{
+    window->presence += (faults & DS18B20_FAULT_PRESENCE) ? direction : 0;
+    window->crc += (faults & DS18B20_FAULT_CRC) ? direction : 0;
+    window->timeout += (faults & DS18B20_FAULT_TIMEOUT) ? direction : 0;
+    window->retry += (faults & DS18B20_FAULT_RETRY) ? direction : 0;
+    window->crc_checked += (faults & DS18B20_SAMPLE_CRC_CHECKED) ? direction : 0;
+}
+
+static DS18B20_QUALITY _quality(int score)
+{
+    if (score >= CONFIG_TEMP_DIAGNOSTICS_DEGRADED_SCORE)
+    {
+        return DS18B20_QUALITY_GOOD;
+    }
+    return score >= CONFIG_TEMP_DIAGNOSTICS_POOR_SCORE ? DS18B20_QUALITY_DEGRADED : DS18B20_QUALITY_POOR;
+}
+
+static void _log_window(const char *name, int index, const DS18B20_DiagnosticsWindow *window)
+{
+    ESP_LOGI(TAG, "%s %d: score %d, presence %u, crc %u/%u, timeout %u, retry %u of %u samples, %u of %u faulty since init",
+             name, index, ds18b20_diagnostics_score(window), window->presence, window->crc, window->crc_checked,
+             window->timeout, window->retry, window->count, window->total_faulty, window->total);
+}
+
+// Public API
+
+void ds18b20_diagnostics_init(DS18B20_Diagnostics *diagnostics, int device_count)
+{
+    if (diagnostics != NULL)
+    {
+        memset(diagnostics, 0, sizeof(*diagnostics));
+        diagnostics->device_count = device_count < DS18B20_DIAGNOSTICS_MAX_DEVICES ? device_count : DS18B20_DIAGNOSTICS_MAX_DEVICES;
+    }
+}
+
+uint8_t ds18b20_diagnostics_faults(DS18B20_ERROR err, bool crc_checked, int retries)
+{
+    uint8_t faults = crc_checked ? DS18B20_SAMPLE_CRC_CHECKED : 0;
+    switch (err)
+    {
+    case DS18B20_ERROR_DEVICE:
+    case DS18B20_ERROR_OWB:
+        faults |= DS18B20_FAULT_PRESENCE;
+        break;
+    case DS18B20_ERROR_CRC:
+        faults |= DS18B20_FAULT_CRC;
+        break;
+    case DS18B20_ERROR_TIMEOUT:
+        faults |= DS18B20_FAULT_TIMEOUT;
+        break;
+    default:
+        break;
+    }
+    if (retries > 0 && err == DS18B20_OK)
+    {
+        faults |= DS18B20_FAULT_RETRY;
+    }
+    return faults;
+}
+
+bool ds18b20_diagnostics_record(DS18B20_DiagnosticsWindow *window, uint8_t faults)
+{
+    if (window == NULL)
+    {
+        return false;
+    }
+    if (window->count == DS18B20_DIAGNOSTICS_WINDOW)
+    {
+        _count(window, window->samples[window->next], -1);
+    }
+    else
+    {
+        ++window->count;
+    }
+    window->samples[window->next] = faults;
+    window->next = (window->next + 1) % DS18B20_DIAGNOSTICS_WINDOW;
+    _count(window, faults, 1);
+
+    ++window->total;
+    if (faults & ~DS18B20_SAMPLE_CRC_CHECKED)
+    {
+        ++window->total_faulty;
+    }
+
+    DS18B20_QUALITY quality = _quality(ds18b20_diagnostics_score(window));
+    bool changed = quality != window->quality;
+    window->quality = quality;
+    return changed;
+}
+
+int ds18b20_diagnostics_score(const DS18B20_DiagnosticsWindow *window)
+{
+    if (window == NULL || window->count == 0)
+    {
+        return 100;
+    }
+    // penalties in points, from rates in percent
+    int32_t penalty = (200 * window->presence + 100 * window->timeout + 50 * window->retry) / window->count;
+    if (window->crc_checked > 0)
+    {
+        penalty += 200 * window->crc / window->crc_checked;
+    }
+    return penalty < 100 ? 100 - penalty : 0;
+}
+
+void ds18b20_diagnostics_log(const DS18B20_Diagnostics *diagnostics)
+{
+    if (diagnostics != NULL)
+    {
+        _log_window("bus", 0, &diagnostics->bus);
+        for (int i = 0; i < diagnostics->device_count; ++i)
+        {
+            _log_window("device", i, &diagnostics->devices[i]);
+        }
+    }
+}
+
+#endif // CONFIG_TEMP_DIAGNOSTICS
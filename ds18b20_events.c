@@ -0,0 +1,148 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_events.c
+ *
+ * Thin layer over esp_event so the wrapper does not need to know whether it runs on a target
+ * with an event loop or on a host build with the local stand-in.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+#include "esp_log.h"
+
+#include "ds18b20_events.h"
+
+#ifdef CONFIG_TEMP_EVENTS
+
+static const char *TAG = CONFIG_TEMP_TAG; ///< tag for logging
+
+ESP_EVENT_DEFINE_BASE(DS18B20_EVENT);
+
+#ifdef CONFIG_IDF_TARGET_LINUX
+
+#define MAX_HANDLERS 8 ///< number of handlers the host stand-in can hold
+
+/// @cond ignore
+typedef struct
+{
+    int32_t event_id;
+    esp_event_handler_t handler;
+    void *arg;
+} Handler;
+/// @endcond ignore
+
+static Handler handlers[MAX_HANDLERS] = {0}; ///< registered handlers, unused entries have a NULL handler
+
+DS18B20_ERROR ds18b20_events_register(int32_t event_id, esp_event_handler_t handler, void *arg)
+{
+    if (handler == NULL)
+    {
+        return DS18B20_ERROR_NULL;
+    }
+    for (int i = 0; i < MAX_HANDLERS; ++i)
+    {
+        if (handlers[i].handler == NULL)
+        {
+            handlers[i] = (Handler){.event_id = event_id, .handler = handler, .arg = arg};
+            return DS18B20_OK;
+        }
+    }
+    ESP_LOGE(TAG, "no room for another event handler");
+    return DS18B20_ERROR_PARAM;
+}
+
+DS18B20_ERROR ds18b20_events_unregister(int32_t event_id, esp_event_handler_t handler)
+{
+    DS18B20_ERROR err = DS18B20_ERROR_PARAM;
+    for (int i = 0; i < MAX_HANDLERS; ++i)
+    {
+        if (handlers[i].handler == handler && handlers[i].event_id == event_id)
+        {
+            handlers[i].handler = NULL;
+            err = DS18B20_OK;
+        }
+    }
+    return err;
+}
+
+DS18B20_ERROR ds18b20_events_post(DS18B20_EVENT_ID event_id, const DS18B20_EventData *data)
+{
+    if (data == NULL)
+    {
+        return DS18B20_ERROR_NULL;
+    }
+    // handlers get their own copy, as they would from an event loop
+    for (int i = 0; i < MAX_HANDLERS; ++i)
+    {
+        if (handlers[i].handler != NULL && (handlers[i].event_id == event_id || handlers[i].event_id == ESP_EVENT_ANY_ID))
+        {
+            DS18B20_EventData copy = *data;
+            handlers[i].handler(handlers[i].arg, DS18B20_EVENT, event_id, &copy);
+        }
+    }
+    return DS18B20_OK;
+}
+
+#else
+
+DS18B20_ERROR ds18b20_events_register(int32_t event_id, esp_event_handler_t handler, void *arg)
+{
+    esp_err_t err = esp_event_handler_register(DS18B20_EVENT, event_id, handler, arg);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "event handler register failed: %s", esp_err_to_name(err));
+    }
+    return err == ESP_OK ? DS18B20_OK : DS18B20_ERROR_UNKNOWN;
+}
+
+DS18B20_ERROR ds18b20_events_unregister(int32_t event_id, esp_event_handler_t handler)
+{
+    esp_err_t err = esp_event_handler_unregister(DS18B20_EVENT, event_id, handler);
+    return err == ESP_OK ? DS18B20_OK : DS18B20_ERROR_UNKNOWN;
+}
+
+DS18B20_ERROR ds18b20_events_post(DS18B20_EVENT_ID event_id, const DS18B20_EventData *data)
+{
+    if (data == NULL)
+    {
+        return DS18B20_ERROR_NULL;
+    }
+    // never block the sampling task, a full queue drops the event
+    esp_err_t err = esp_event_post(DS18B20_EVENT, event_id, data, sizeof(*data), 0);
+    if (err != ESP_OK)
+    {
+        ESP_LOGD(TAG, "event %d not posted: %s", event_id, esp_err_to_name(err));
+    }
+    return err == ESP_OK ? DS18B20_OK : DS18B20_ERROR_UNKNOWN;
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
+
+#endif // CONFIG_TEMP_EVENTS
@@ -0,0 +1,146 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_group.c
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "ds18b20_group.h"
+
+#ifdef CONFIG_TEMP_GROUPS
+
+static const char *TAG = CONFIG_TEMP_TAG; ///< tag for logging
+
+DS18B20_ERROR ds18b20_group_init(DS18B20_Group *group, const char *name, DS18B20_Info **devices, int count)
+{
+    if (group == NULL || name == NULL || devices == NULL)
+    {
+        ESP_LOGE(TAG, "group, name or devices is NULL");
+        return DS18B20_ERROR_NULL;
+    }
+    if (count <= 0)
+    {
+        ESP_LOGE(TAG, "group %s has no devices", name);
+        return DS18B20_ERROR_PARAM;
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        if (devices[i] == NULL || !devices[i]->init || devices[i]->bus != devices[0]->bus)
+        {
+            ESP_LOGE(TAG, "group %s device %d is not initialised on the group's bus", name, i);
+            return DS18B20_ERROR_PARAM;
+        }
+        if (count > 1 && ds18b20_is_parasitic(devices[i]))
+        {
+            // addressing the next device would end the strong pull-up this one converts on
+            ESP_LOGE(TAG, "group %s device %d is parasitic-powered and must be alone in its group", name, i);
+            return DS18B20_ERROR_PARAM;
+        }
+    }
+
+    memset(group, 0, sizeof(*group));
+    strncpy(group->name, name, sizeof(group->name) - 1);
+    group->bus = devices[0]->bus;
+    group->devices = devices;
+    group->count = count;
+    ds18b20_group_update(group);
+    return DS18B20_OK;
+}
+
+void ds18b20_group_update(DS18B20_Group *group)
+{
+    group->conversion_us = 0;
+    for (int i = 0; i < group->count; ++i)
+    {
+        int64_t conversion_us = ds18b20_conversion_time_us(group->devices[i]);
+        group->conversion_us = conversion_us > group->conversion_us ? conversion_us : group->conversion_us;
+    }
+    ESP_LOGD(TAG, "group %s: %d devices, conversion %lld us", group->name, group->count, group->conversion_us);
+}
+
+DS18B20_ERROR ds18b20_group_convert(DS18B20_Group *group)
+{
+    DS18B20_ERROR err = DS18B20_OK;
+    // keep the addressed conversions together so another task cannot delay the last of them
+    ds18b20_bus_lock(group->bus);
+    for (int i = 0; i < group->count; ++i)
+    {
+        if (!ds18b20_convert(group->devices[i]))
+        {
+            err = DS18B20_ERROR_DEVICE;
+        }
+    }
+    ds18b20_bus_unlock(group->bus);
+    // the first device finishes sooner, the group is timed from the last conversion started
+    group->ready_us = esp_timer_get_time() + group->conversion_us;
+    return err;
+}
+
+int64_t ds18b20_group_remaining_us(const DS18B20_Group *group)
+{
+    int64_t remaining_us = group->ready_us - esp_timer_get_time();
+    return group->ready_us != 0 && remaining_us > 0 ? remaining_us : 0;
+}
+
+void ds18b20_group_wait(const DS18B20_Group *group)
+{
+    if (group->ready_us != 0)
+    {
+        ds18b20_sleep_until(group->ready_us);
+    }
+}
+
+DS18B20_ERROR ds18b20_group_read(DS18B20_Group *group, int16_t *values, DS18B20_ERROR *errors)
+{
+    if (values == NULL)
+    {
+        ESP_LOGE(TAG, "values is NULL");
+        return DS18B20_ERROR_NULL;
+    }
+    ds18b20_group_wait(group);
+    group->ready_us = 0;
+
+    DS18B20_ERROR result = DS18B20_OK;
+    for (int i = 0; i < group->count; ++i)
+    {
+        DS18B20_ERROR err = ds18b20_read_temp_raw(group->devices[i], &values[i]);
+        if (errors != NULL)
+        {
+            errors[i] = err;
+        }
+        result = result == DS18B20_OK ? err : result;
+    }
+    return result;
+}
+
+#endif // CONFIG_TEMP_GROUPS
@@ -0,0 +1,635 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_history.c
+ *
+ * Storage layout: the backing storage is divided into segments of CONFIG_TEMP_HISTORY_SEGMENT_SIZE
+ * bytes. Each segment starts with a header holding a magic number, a sequence number and the
+ * timestamp of its first sweep, followed by records. A record is a length prefix (one byte below
+ * 0x80, otherwise two bytes with the top bit set) and a bit-packed payload. The prefix is written
+ * after the payload, so an erased (0xFF) prefix marks the end of the segment even after a power
+ * loss mid-append.
+ *
+ * Payload, MSB first:
+ *  - reading count: '0' if unchanged, otherwise '1' and 16 bits
+ *  - timestamp delta-of-delta, zigzag encoded: '0', or '10', '110', '1110', '1111' followed by
+ *    7, 12, 20 or 64 bits
+ *  - per reading, zigzag encoded delta from the previous reading of the same index: '0', or
+ *    '10', '110', '111' followed by 3, 7 or 17 bits. A failed read is stored as
+ *    DS18B20_HISTORY_INVALID, which costs a single bit for as long as the device keeps failing
+ *
+ * Every segment starts from a blank encoder state, so any segment can be decoded on its own
+ * and discarding the oldest segment never invalidates the others.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "esp_system.h"
+#include "esp_log.h"
+#ifndef CONFIG_IDF_TARGET_LINUX
+#include "esp_partition.h"
+#endif
+
+#include "ds18b20_history.h"
+
+#ifdef CONFIG_TEMP_HISTORY
+
+static const char *TAG = CONFIG_TEMP_TAG; ///< tag for logging
+
+#define HISTORY_MAGIC 0x31485344                        ///< "DSH1" in little endian
+#define SEGMENT_SIZE (CONFIG_TEMP_HISTORY_SEGMENT_SIZE) ///< bytes per segment, a multiple of the flash sector size
+#define ERASED 0xFF                                     ///< value of an erased flash byte
+
+/// @cond ignore
+typedef struct
+{
+    uint32_t magic;
+    uint32_t sequence;
+    int64_t base_time_ms;
+} __attribute__((packed)) SegmentHeader;
+
+typedef struct
+{
+    uint8_t *buffer;
+    size_t length;   // in bytes
+    size_t position; // in bits
+} BitStream;
+/// @endcond ignore
+
+static const uint8_t TIME_WIDTHS[] = {0, 7, 12, 20, 64}; ///< payload bits for each timestamp code
+static const uint8_t VALUE_WIDTHS[] = {0, 3, 7, 17};     ///< payload bits for each reading code
+
+// Backing storage
+
+static bool _storage_open(DS18B20_History *history, uint32_t *size)
+{
+#ifdef CONFIG_IDF_TARGET_LINUX
+    bool format = false;
+    history->file = fopen(CONFIG_TEMP_HISTORY_FILE, "r+b");
+    if (history->file == NULL)
+    {
+        history->file = fopen(CONFIG_TEMP_HISTORY_FILE, "w+b");
+        format = true;
+    }
+    *size = CONFIG_TEMP_HISTORY_FILE_SIZE;
+    if (history->file != NULL && format)
+    {
+        // a new file must look like erased flash
+        uint8_t erased[64];
+        memset(erased, ERASED, sizeof(erased));
+        for (uint32_t i = 0; i < *size; i += sizeof(erased))
+        {
+            fwrite(erased, 1, sizeof(erased), history->file);
+        }
+        fflush(history->file);
+    }
+    return history->file != NULL;
+#else
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                                CONFIG_TEMP_HISTORY_PARTITION_LABEL);
+    history->partition = partition;
+    *size = partition != NULL ? partition->size : 0;
+    return partition != NULL;
+#endif
+}
+
+static void _storage_close(DS18B20_History *history)
+{
+#ifdef CONFIG_IDF_TARGET_LINUX
+    if (history->file != NULL)
+    {
+        fclose(history->file);
+        history->file = NULL;
+    }
+#else
+    history->partition = NULL;
+#endif
+}
+
+static bool _storage_read(const DS18B20_History *history, uint32_t address, void *data, size_t length)
+{
+#ifdef CONFIG_IDF_TARGET_LINUX
+    return fseek(history->file, address, SEEK_SET) == 0 && fread(data, 1, length, history->file) == length;
+#else
+    return esp_partition_read(history->partition, address, data, length) == ESP_OK;
+#endif
+}
+
+static bool _storage_write(const DS18B20_History *history, uint32_t address, const void *data, size_t length)
+{
+#ifdef CONFIG_IDF_TARGET_LINUX
+    bool ok = fseek(history->file, address, SEEK_SET) == 0 && fwrite(data, 1, length, history->file) == length;
+    return ok && fflush(history->file) == 0;
+#else
+    return esp_partition_write(history->partition, address, data, length) == ESP_OK;
+#endif
+}
+
+static bool _storage_erase(const DS18B20_History *history, uint32_t address, size_t length)
+{
+#ifdef CONFIG_IDF_TARGET_LINUX
+    uint8_t erased[64];
+    memset(erased, ERASED, sizeof(erased));
+    bool ok = fseek(history->file, address, SEEK_SET) == 0;
+    for (size_t i = 0; ok && i < length; i += sizeof(erased))
+    {
+        ok = fwrite(erased, 1, sizeof(erased), history->file) == sizeof(erased);
+    }
+    return ok && fflush(history->file) == 0;
+#else
+    return esp_partition_erase_range(history->partition, address, length) == ESP_OK;
+#endif
+}
+
+// Bit packing
+
+static void _put_bits(BitStream *stream, uint64_t value, int count)
+{
+    for (int i = count - 1; i >= 0; --i)
+    {
+        uint8_t mask = 0x80 >> (stream->position & 0x07);
+        if ((value >> i) & 0x01)
+        {
+            stream->buffer[stream->position >> 3] |= mask;
+        }
+        ++stream->position;
+    }
+}
+
+static bool _get_bits(BitStream *stream, int count, uint64_t *value)
+{
+    if (stream->position + count > stream->length * 8)
+    {
+        return false;
+    }
+    uint64_t result = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        uint8_t bit = (stream->buffer[stream->position >> 3] >> (7 - (stream->position & 0x07))) & 0x01;
+        result = (result << 1) | bit;
+        ++stream->position;
+    }
+    *value = result;
+    return true;
+}
+
+static uint64_t _zigzag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t _unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 0x01);
+}
+
+static void _put_code(BitStream *stream, uint64_t value, const uint8_t *widths, int count)
+{
+    // the code index is sent in unary, the last code needs no terminating zero
+    int code = 0;
+    while (code < count - 1 && value >= (1ULL << widths[code]))
+    {
+        ++code;
+    }
+    for (int i = 0; i < code; ++i)
+    {
+        _put_bits(stream, 1, 1);
+    }
+    if (code < count - 1)
+    {
+        _put_bits(stream, 0, 1);
+    }
+    _put_bits(stream, value, widths[code]);
+}
+
+static bool _get_code(BitStream *stream, const uint8_t *widths, int count, uint64_t *value)
+{
+    int code = 0;
+    uint64_t bit = 0;
+    while (code < count - 1)
+    {
+        if (!_get_bits(stream, 1, &bit))
+        {
+            return false;
+        }
+        if (!bit)
+        {
+            break;
+        }
+        ++code;
+    }
+    return _get_bits(stream, widths[code], value);
+}
+
+// Sweep encoding
+
+static void _codec_reset(DS18B20_HistoryCodec *codec, int64_t base_time_ms)
+{
+    memset(codec, 0, sizeof(*codec));
+    codec->last_time_ms = base_time_ms;
+}
+
+static int16_t _stored_value(const int16_t *values, const DS18B20_ERROR *errors, int index)
+{
+    return errors != NULL && errors[index] != DS18B20_OK ? DS18B20_HISTORY_INVALID : values[index];
+}
+
+static void _codec_update(DS18B20_HistoryCodec *codec, int64_t time_ms, const int16_t *values,
+                          const DS18B20_ERROR *errors, int count)
+{
+    codec->last_delta_ms = time_ms - codec->last_time_ms;
+    codec->last_time_ms = time_ms;
+    codec->last_count = count;
+    for (int i = 0; i < count; ++i)
+    {
+        codec->last_values[i] = _stored_value(values, errors, i);
+    }
+}
+
+static size_t _encode(const DS18B20_HistoryCodec *codec, uint8_t *payload, int64_t time_ms, const int16_t *values,
+                      const DS18B20_ERROR *errors, int count)
+{
+    BitStream stream = {.buffer = payload, .length = DS18B20_HISTORY_RECORD_MAX_BYTES, .position = 0};
+    memset(payload, 0, DS18B20_HISTORY_RECORD_MAX_BYTES);
+
+    if (count == codec->last_count)
+    {
+        _put_bits(&stream, 0, 1);
+    }
+    else
+    {
+        _put_bits(&stream, 1, 1);
+        _put_bits(&stream, count, 16);
+    }
+
+    int64_t delta = time_ms - codec->last_time_ms;
+    _put_code(&stream, _zigzag(delta - codec->last_delta_ms), TIME_WIDTHS, sizeof(TIME_WIDTHS));
+
+    for (int i = 0; i < count; ++i)
+    {
+        // readings beyond the previous count are encoded against zero
+        int32_t previous = i < codec->last_count ? codec->last_values[i] : 0;
+        _put_code(&stream, _zigzag((int32_t)_stored_value(values, errors, i) - previous), VALUE_WIDTHS,
+                  sizeof(VALUE_WIDTHS));
+    }
+    return (stream.position + 7) / 8;
+}
+
+static bool _decode(DS18B20_HistoryCodec *codec, uint8_t *payload, size_t length)
+{
+    BitStream stream = {.buffer = payload, .length = length, .position = 0};
+    uint64_t value = 0;
+
+    int count = codec->last_count;
+    if (!_get_bits(&stream, 1, &value))
+    {
+        return false;
+    }
+    if (value)
+    {
+        if (!_get_bits(&stream, 16, &value) || value > DS18B20_HISTORY_MAX_DEVICES)
+        {
+            return false;
+        }
+        count = value;
+    }
+
+    if (!_get_code(&stream, TIME_WIDTHS, sizeof(TIME_WIDTHS), &value))
+    {
+        return false;
+    }
+    int64_t delta = codec->last_delta_ms + _unzigzag(value);
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (!_get_code(&stream, VALUE_WIDTHS, sizeof(VALUE_WIDTHS), &value))
+        {
+            return false;
+        }
+        int32_t previous = i < codec->last_count ? codec->last_values[i] : 0;
+        codec->last_values[i] = (int16_t)(previous + _unzigzag(value));
+    }
+    codec->last_count = count;
+    codec->last_delta_ms = delta;
+    codec->last_time_ms += delta;
+    return true;
+}
+
+// Segments
+
+static uint32_t _segment_address(uint32_t segment)
+{
+    return segment * SEGMENT_SIZE;
+}
+
+static bool _read_header(const DS18B20_History *history, uint32_t segment, SegmentHeader *header)
+{
+    return _storage_read(history, _segment_address(segment), header, sizeof(*header)) && header->magic == HISTORY_MAGIC;
+}
+
+static bool _start_segment(DS18B20_History *history, uint32_t segment, uint32_t sequence, int64_t base_time_ms)
+{
+    SegmentHeader header = {.magic = HISTORY_MAGIC, .sequence = sequence, .base_time_ms = base_time_ms};
+    bool ok = _storage_erase(history, _segment_address(segment), SEGMENT_SIZE) &&
+              _storage_write(history, _segment_address(segment), &header, sizeof(header));
+    if (ok)
+    {
+        ESP_LOGD(TAG, "history segment %u started, sequence %u", segment, sequence);
+        history->active_segment = segment;
+        history->sequence = sequence;
+        history->write_offset = sizeof(header);
+        _codec_reset(&history->codec, base_time_ms);
+    }
+    else
+    {
+        ESP_LOGE(TAG, "failed to start history segment %u", segment);
+    }
+    return ok;
+}
+
+/**
+ * Decode the records of a segment, optionally reporting each sweep. Returns the offset just
+ * past the last valid record, and leaves the codec holding the state after that record.
+ */
+static uint32_t _scan_segment(DS18B20_History *history, uint32_t segment, DS18B20_HistoryCodec *codec,
+                              DS18B20_HistoryCallback callback, void *arg, bool *stop)
+{
+    SegmentHeader header = {0};
+    if (!_read_header(history, segment, &header))
+    {
+        return 0;
+    }
+    _codec_reset(codec, header.base_time_ms);
+
+    uint32_t address = _segment_address(segment);
+    uint32_t offset = sizeof(header);
+    while (offset < SEGMENT_SIZE)
+    {
+        uint8_t prefix[2] = {ERASED, ERASED};
+        if (!_storage_read(history, address + offset, prefix, 1) || prefix[0] == ERASED)
+        {
+            break;
+        }
+        size_t prefix_length = 1;
+        size_t length = prefix[0];
+        if (prefix[0] & 0x80)
+        {
+            if (!_storage_read(history, address + offset + 1, &prefix[1], 1))
+            {
+                break;
+            }
+            prefix_length = 2;
+            length = ((prefix[0] & 0x7f) << 8) | prefix[1];
+        }
+        if (length > sizeof(history->record) || offset + prefix_length + length > SEGMENT_SIZE ||
+            !_storage_read(history, address + offset + prefix_length, history->record, length) ||
+            !_decode(codec, history->record, length))
+        {
+            ESP_LOGW(TAG, "corrupt history record in segment %u at offset %u", segment, offset);
+            break;
+        }
+        offset += prefix_length + length;
+
+        if (callback != NULL && !callback(codec->last_time_ms, codec->last_values, codec->last_count, arg))
+        {
+            *stop = true;
+            break;
+        }
+    }
+    return offset;
+}
+
+static bool _is_erased(DS18B20_History *history, uint32_t address, size_t length)
+{
+    bool erased = true;
+    while (erased && length > 0)
+    {
+        size_t chunk = length < sizeof(history->record) ? length : sizeof(history->record);
+        erased = _storage_read(history, address, history->record, chunk);
+        for (size_t i = 0; erased && i < chunk; ++i)
+        {
+            erased = history->record[i] == ERASED;
+        }
+        address += chunk;
+        length -= chunk;
+    }
+    return erased;
+}
+
+static bool _is_open(const DS18B20_History *history)
+{
+    bool ok = false;
+    if (history != NULL)
+    {
+        if (history->init)
+        {
+            ok = true;
+        }
+        else
+        {
+            ESP_LOGE(TAG, "history is not open");
+        }
+    }
+    else
+    {
+        ESP_LOGE(TAG, "history is NULL");
+    }
+    return ok;
+}
+
+// Public API
+
+DS18B20_ERROR ds18b20_history_open(DS18B20_History *history)
+{
+    if (history == NULL)
+    {
+        ESP_LOGE(TAG, "history is NULL");
+        return DS18B20_ERROR_NULL;
+    }
+    memset(history, 0, sizeof(*history));
+
+    uint32_t size = 0;
+    if (!_storage_open(history, &size))
+    {
+        ESP_LOGE(TAG, "history storage not found");
+        return DS18B20_ERROR_STORAGE;
+    }
+    history->segment_count = size / SEGMENT_SIZE;
+    if (history->segment_count < 2)
+    {
+        ESP_LOGE(TAG, "history storage too small: %u bytes", size);
+        _storage_close(history);
+        return DS18B20_ERROR_STORAGE;
+    }
+
+    // the newest segment is the one with the highest sequence number
+    bool found = false;
+    SegmentHeader header = {0};
+    for (uint32_t i = 0; i < history->segment_count; ++i)
+    {
+        if (_read_header(history, i, &header) && (!found || (int32_t)(header.sequence - history->sequence) > 0))
+        {
+            found = true;
+            history->active_segment = i;
+            history->sequence = header.sequence;
+        }
+    }
+
+    bool ok = false;
+    if (found)
+    {
+        bool stop = false;
+        history->write_offset = _scan_segment(history, history->active_segment, &history->codec, NULL, NULL, &stop);
+
+        // a record interrupted by power loss leaves programmed bytes behind the end marker
+        size_t tail = SEGMENT_SIZE - history->write_offset;
+        tail = tail < DS18B20_HISTORY_RECORD_MAX_BYTES ? tail : DS18B20_HISTORY_RECORD_MAX_BYTES;
+        ok = _is_erased(history, _segment_address(history->active_segment) + history->write_offset, tail);
+        if (!ok)
+        {
+            ESP_LOGW(TAG, "history segment %u has a torn record, moving on", history->active_segment);
+            ok = _start_segment(history, (history->active_segment + 1) % history->segment_count,
+                                history->sequence + 1, history->codec.last_time_ms);
+        }
+    }
+    else
+    {
+        ESP_LOGI(TAG, "formatting history storage");
+        ok = _start_segment(history, 0, 1, 0);
+    }
+
+    if (!ok)
+    {
+        _storage_close(history);
+        return DS18B20_ERROR_STORAGE;
+    }
+    history->init = true;
+    ESP_LOGI(TAG, "history open: %u segments, active %u at offset %u",
+             history->segment_count, history->active_segment, history->write_offset);
+    return DS18B20_OK;
+}
+
+void ds18b20_history_close(DS18B20_History *history)
+{
+    if (_is_open(history))
+    {
+        _storage_close(history);
+        history->init = false;
+    }
+}
+
+DS18B20_ERROR ds18b20_history_append(DS18B20_History *history, int64_t time_ms, const int16_t *values,
+                                     const DS18B20_ERROR *errors, int count)
+{
+    if (!_is_open(history))
+    {
+        return DS18B20_ERROR_UNKNOWN;
+    }
+    if (values == NULL)
+    {
+        return DS18B20_ERROR_NULL;
+    }
+    if (count < 0 || count > DS18B20_HISTORY_MAX_DEVICES)
+    {
+        ESP_LOGE(TAG, "invalid history sweep size %d", count);
+        return DS18B20_ERROR_PARAM;
+    }
+
+    size_t length = _encode(&history->codec, history->record, time_ms, values, errors, count);
+    size_t prefix_length = length < 0x80 ? 1 : 2;
+    if (history->write_offset + prefix_length + length > SEGMENT_SIZE)
+    {
+        // the next segment in turn is the oldest, so it is the one to discard
+        if (!_start_segment(history, (history->active_segment + 1) % history->segment_count,
+                            history->sequence + 1, time_ms))
+        {
+            return DS18B20_ERROR_STORAGE;
+        }
+        length = _encode(&history->codec, history->record, time_ms, values, errors, count);
+        prefix_length = length < 0x80 ? 1 : 2;
+    }
+
+    uint8_t prefix[2] = {length, 0};
+    if (prefix_length == 2)
+    {
+        prefix[0] = 0x80 | (length >> 8);
+        prefix[1] = length & 0xff;
+    }
+
+    // payload first, the prefix commits the record
+    uint32_t address = _segment_address(history->active_segment) + history->write_offset;
+    if (!_storage_write(history, address + prefix_length, history->record, length) ||
+        !_storage_write(history, address, prefix, prefix_length))
+    {
+        ESP_LOGE(TAG, "history write failed at offset %u", history->write_offset);
+        return DS18B20_ERROR_STORAGE;
+    }
+    history->write_offset += prefix_length + length;
+    _codec_update(&history->codec, time_ms, values, errors, count);
+    return DS18B20_OK;
+}
+
+DS18B20_ERROR ds18b20_history_iterate(DS18B20_History *history, DS18B20_HistoryCallback callback, void *arg)
+{
+    if (!_is_open(history))
+    {
+        return DS18B20_ERROR_UNKNOWN;
+    }
+    if (callback == NULL)
+    {
+        return DS18B20_ERROR_NULL;
+    }
+
+    // segments are filled round robin, so the oldest follows the active one
+    DS18B20_HistoryCodec codec;
+    bool stop = false;
+    for (uint32_t i = 1; i <= history->segment_count && !stop; ++i)
+    {
+        uint32_t segment = (history->active_segment + i) % history->segment_count;
+        _scan_segment(history, segment, &codec, callback, arg, &stop);
+    }
+    return DS18B20_OK;
+}
+
+DS18B20_ERROR ds18b20_history_erase(DS18B20_History *history)
+{
+    if (!_is_open(history))
+    {
+        return DS18B20_ERROR_UNKNOWN;
+    }
+    bool ok = true;
+    for (uint32_t i = 1; i < history->segment_count && ok; ++i)
+    {
+        ok = _storage_erase(history, _segment_address(i), SEGMENT_SIZE);
+    }
+    ok = ok && _start_segment(history, 0, history->sequence + 1, history->codec.last_time_ms);
+    return ok ? DS18B20_OK : DS18B20_ERROR_STORAGE;
+}
+
+#endif // CONFIG_TEMP_HISTORY
@@ -0,0 +1,283 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_manifest.c
+ *
+ * One side of the check is sorted once and the other side is found in it by binary search, so
+ * checking n expected against m found devices costs O((n + m) log n) or O((n + m) log m) and no
+ * bus traffic.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "esp_system.h"
+#include "esp_log.h"
+
+#include "ds18b20_manifest.h"
+
+#ifdef CONFIG_TEMP_MANIFEST_CHECK
+
+static const char *TAG = CONFIG_TEMP_TAG; ///< tag for logging
+
+static uint64_t _key(OneWireBus_ROMCode rom_code)
+{
+    uint64_t key = 0;
+    for (int i = sizeof(rom_code.bytes) - 1; i >= 0; --i)
+    {
+        key = (key << 8) | rom_code.bytes[i];
+    }
+    return key;
+}
+
+static int _compare(const void *a, const void *b)
+{
+    uint64_t key_a = ((const DS18B20_ManifestKey *)a)->key;
+    uint64_t key_b = ((const DS18B20_ManifestKey *)b)->key;
+    return key_a < key_b ? -1 : key_a > key_b;
+}
+
+static int _hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    c = tolower((unsigned char)c);
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+static void _log_result(const DS18B20_ManifestResult *result)
+{
+    char rom_code_s[OWB_ROM_CODE_STRING_LENGTH];
+    for (int i = 0; i < result->missing_count; ++i)
+    {
+        owb_string_from_rom_code(result->missing[i], rom_code_s, sizeof(rom_code_s));
+        ESP_LOGW(TAG, "expected device %s not present", rom_code_s);
+    }
+    for (int i = 0; i < result->unexpected_count; ++i)
+    {
+        owb_string_from_rom_code(result->unexpected[i], rom_code_s, sizeof(rom_code_s));
+        ESP_LOGW(TAG, "unexpected device %s present", rom_code_s);
+    }
+    ESP_LOGI(TAG, "manifest: %d of %d expected devices present, %d unexpected",
+             result->present_count, result->expected_count, result->unexpected_count);
+}
+
+// Public API
+
+int ds18b20_manifest_parse(const char *text, OneWireBus_ROMCode *rom_codes, int size)
+{
+    if (text == NULL || rom_codes == NULL)
+    {
+        return -1;
+    }
+
+    int count = 0;
+    while (*text != '\0')
+    {
+        if (*text == ',' || isspace((unsigned char)*text))
+        {
+            ++text;
+            continue;
+        }
+        if (count >= size)
+        {
+            ESP_LOGE(TAG, "manifest has more than %d devices", size);
+            return -1;
+        }
+
+        // most significant byte first, as printed by owb_string_from_rom_code
+        uint64_t key = 0;
+        int digits = 0;
+        for (; _hex_digit(*text) >= 0; ++text, ++digits)
+        {
+            key = (key << 4) | _hex_digit(*text);
+        }
+        if (digits != 2 * sizeof(rom_codes[count].bytes))
+        {
+            ESP_LOGE(TAG, "invalid rom code in manifest at device %d", count);
+            return -1;
+        }
+        for (int i = 0; i < sizeof(rom_codes[count].bytes); ++i)
+        {
+            rom_codes[count].bytes[i] = key >> (8 * i);
+        }
+        ++count;
+    }
+    return count;
+}
+
+DS18B20_ERROR ds18b20_manifest_check(const OneWireBus_ROMCode *expected, int expected_count,
+                                     const OneWireBus_ROMCode *found, int found_count,
+                                     DS18B20_ManifestResult *result)
+{
+    if (result == NULL || (expected == NULL && expected_count > 0) || (found == NULL && found_count > 0))
+    {
+        return DS18B20_ERROR_NULL;
+    }
+    if (expected_count < 0 || expected_count > DS18B20_MANIFEST_MAX_DEVICES ||
+        found_count < 0 || found_count > DS18B20_MANIFEST_MAX_DEVICES)
+    {
+        return DS18B20_ERROR_PARAM;
+    }
+
+    DS18B20_ManifestKey sorted[DS18B20_MANIFEST_MAX_DEVICES];
+    bool matched[DS18B20_MANIFEST_MAX_DEVICES] = {0};
+    for (int i = 0; i < found_count; ++i)
+    {
+        sorted[i].key = _key(found[i]);
+        sorted[i].index = i;
+    }
+    qsort(sorted, found_count, sizeof(sorted[0]), _compare);
+
+    memset(result, 0, sizeof(*result));
+    result->expected_count = expected_count;
+    for (int i = 0; i < expected_count; ++i)
+    {
+        DS18B20_ManifestKey key = {.key = _key(expected[i]), .index = 0};
+        DS18B20_ManifestKey *match = bsearch(&key, sorted, found_count, sizeof(sorted[0]), _compare);
+        if (match != NULL)
+        {
+            matched[match->index] = true;
+            ++result->present_count;
+        }
+        else
+        {
+            result->missing[result->missing_count++] = expected[i];
+        }
+    }
+    for (int i = 0; i < found_count; ++i)
+    {
+        if (!matched[i])
+        {
+            result->unexpected[result->unexpected_count++] = found[i];
+        }
+    }
+
+    _log_result(result);
+    return result->missing_count == 0 && result->unexpected_count == 0 ? DS18B20_OK : DS18B20_ERROR_DEVICE;
+}
+
+DS18B20_ERROR ds18b20_manifest_begin(const OneWireBus_ROMCode *expected, int expected_count,
+                                     DS18B20_ManifestResult *result)
+{
+    if (result == NULL || (expected == NULL && expected_count > 0))
+    {
+        return DS18B20_ERROR_NULL;
+    }
+    if (expected_count < 0 || expected_count > DS18B20_MANIFEST_MAX_DEVICES)
+    {
+        return DS18B20_ERROR_PARAM;
+    }
+
+    // every expected device is missing until the search finds it
+    memset(result, 0, sizeof(*result));
+    result->expected_count = expected_count;
+    result->missing_count = expected_count;
+    memcpy(result->missing, expected, expected_count * sizeof(expected[0]));
+    for (int i = 0; i < expected_count; ++i)
+    {
+        result->sorted[i].key = _key(expected[i]);
+        result->sorted[i].index = i;
+    }
+    qsort(result->sorted, expected_count, sizeof(result->sorted[0]), _compare);
+    return DS18B20_OK;
+}
+
+void ds18b20_manifest_add(DS18B20_ManifestResult *result, OneWireBus_ROMCode rom_code)
+{
+    DS18B20_ManifestKey key = {.key = _key(rom_code), .index = 0};
+    DS18B20_ManifestKey *match = bsearch(&key, result->sorted, result->expected_count, sizeof(result->sorted[0]), _compare);
+    if (match != NULL && !result->found[match->index])
+    {
+        // missing[] keeps every expected device until ds18b20_manifest_end() drops the found ones
+        result->found[match->index] = true;
+        --result->missing_count;
+        ++result->present_count;
+    }
+    else if (result->unexpected_count < DS18B20_MANIFEST_MAX_DEVICES)
+    {
+        result->unexpected[result->unexpected_count++] = rom_code;
+    }
+}
+
+DS18B20_ERROR ds18b20_manifest_end(DS18B20_ManifestResult *result)
+{
+    // keep the missing devices in manifest order
+    int kept = 0;
+    for (int i = 0; i < result->expected_count; ++i)
+    {
+        if (!result->found[i])
+        {
+            result->missing[kept++] = result->missing[i];
+        }
+    }
+    _log_result(result);
+    return result->missing_count == 0 && result->unexpected_count == 0 ? DS18B20_OK : DS18B20_ERROR_DEVICE;
+}
+
+DS18B20_ERROR ds18b20_manifest_verify(const OneWireBus *bus, const OneWireBus_ROMCode *expected, int expected_count,
+                                      DS18B20_ManifestResult *result)
+{
+    if (bus == NULL || result == NULL || (expected == NULL && expected_count > 0))
+    {
+        return DS18B20_ERROR_NULL;
+    }
+    if (expected_count < 0 || expected_count > DS18B20_MANIFEST_MAX_DEVICES)
+    {
+        return DS18B20_ERROR_PARAM;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->expected_count = expected_count;
+    for (int i = 0; i < expected_count; ++i)
+    {
+        bool is_present = false;
+        owb_status status = owb_verify_rom(bus, expected[i], &is_present);
+        if (status != OWB_STATUS_OK)
+        {
+            ESP_LOGE(TAG, "an error occurred verifying expected device: %d", status);
+            return DS18B20_ERROR_OWB;
+        }
+        if (is_present)
+        {
+            ++result->present_count;
+        }
+        else
+        {
+            result->missing[result->missing_count++] = expected[i];
+        }
+    }
+
+    _log_result(result);
+    return result->missing_count == 0 ? DS18B20_OK : DS18B20_ERROR_DEVICE;
+}
+
+#endif // CONFIG_TEMP_MANIFEST_CHECK
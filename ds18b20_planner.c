@@ -0,0 +1,325 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_planner.c
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_system.h"
+#include "esp_log.h"
+
+#include "ds18b20_planner.h"
+
+#ifdef CONFIG_TEMP_PLANNER
+
+static const char *TAG = CONFIG_TEMP_TAG; ///< tag for logging
+
+// Standard speed 1-Wire costs, in microseconds
+#define RESET_US 960     ///< reset pulse and presence detect
+#define BYTE_US (8 * 70) ///< eight time slots including recovery
+
+#define POWER_ANY 0       ///< select every request
+#define POWER_EXTERNAL 1  ///< select externally powered requests
+#define POWER_PARASITIC 2 ///< select parasitic requests
+
+static bool _selected(const DS18B20_PlanRequest *request, int power)
+{
+    return power == POWER_ANY || (power == POWER_PARASITIC) == ds18b20_is_parasitic(request->device);
+}
+
+static int32_t _address_us(const DS18B20_Info *device)
+{
+    // skip ROM for a solo device, otherwise match ROM and the 8 byte ROM code
+    return RESET_US + (device->solo ? 1 : 9) * BYTE_US;
+}
+
+static int32_t _convert_us(const DS18B20_Info *device)
+{
+    return _address_us(device) + BYTE_US;
+}
+
+static int32_t _read_us(const DS18B20_Info *device)
+{
+    // with CRC the whole scratchpad is read, otherwise the temperature and a terminating reset
+    return _address_us(device) + BYTE_US + (device->use_crc ? 9 * BYTE_US : 2 * BYTE_US + RESET_US);
+}
+
+static void _step(DS18B20_Plan *plan, DS18B20_STEP type, int request, int32_t at_us)
+{
+    if (plan->step_count < DS18B20_PLAN_MAX_STEPS)
+    {
+        DS18B20_PlanStep *step = &plan->steps[plan->step_count++];
+        step->type = type;
+        step->request = request;
+        step->at_us = at_us;
+    }
+}
+
+static void _wait(DS18B20_Plan *plan, int32_t until_us, bool held)
+{
+    if (until_us > plan->total_us)
+    {
+        _step(plan, DS18B20_STEP_WAIT, -1, until_us);
+        plan->bus_us += held ? until_us - plan->total_us : 0;
+        plan->total_us = until_us;
+    }
+}
+
+static void _convert_all(DS18B20_Plan *plan, const DS18B20_PlanRequest *requests, int power)
+{
+    _step(plan, DS18B20_STEP_CONVERT_ALL, -1, plan->total_us);
+    plan->total_us += RESET_US + 2 * BYTE_US;
+    plan->bus_us += RESET_US + 2 * BYTE_US;
+
+    // parasitic devices draw their power through the data line, so the strong pull-up holds the
+    // bus until the slowest of them has finished
+    int32_t held_us = 0;
+    for (int i = 0; i < plan->count; ++i)
+    {
+        int32_t conversion_us = ds18b20_plan_conversion_us(requests[i].device);
+        if (_selected(&requests[i], power) && plan->finish_us[i] < 0)
+        {
+            plan->ready_us[i] = plan->total_us + conversion_us;
+        }
+        if (ds18b20_is_parasitic(requests[i].device) && conversion_us > held_us)
+        {
+            held_us = conversion_us;
+        }
+    }
+    _wait(plan, plan->total_us + held_us, true);
+}
+
+static int _earliest_deadline(const DS18B20_Plan *plan, const DS18B20_PlanRequest *requests, int power, bool converted)
+{
+    int best = -1;
+    for (int i = 0; i < plan->count; ++i)
+    {
+        if (_selected(&requests[i], power) && plan->finish_us[i] < 0 && (plan->ready_us[i] >= 0) == converted &&
+            (best < 0 || requests[i].deadline_us < requests[best].deadline_us))
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+static void _read(DS18B20_Plan *plan, const DS18B20_PlanRequest *requests, int request)
+{
+    _step(plan, DS18B20_STEP_READ, request, plan->total_us);
+    plan->total_us += _read_us(requests[request].device);
+    plan->bus_us += _read_us(requests[request].device);
+    plan->finish_us[request] = plan->total_us;
+    plan->missed += plan->total_us > requests[request].deadline_us ? 1 : 0;
+}
+
+static void _read_converted(DS18B20_Plan *plan, const DS18B20_PlanRequest *requests, int power, int32_t due_us)
+{
+    // non-preemptive earliest deadline first: read the most urgent device that is ready,
+    // or wait for the next device to become ready if none is
+    for (;;)
+    {
+        int next = -1;
+        int32_t next_ready_us = INT32_MAX;
+        for (int i = 0; i < plan->count; ++i)
+        {
+            if (!_selected(&requests[i], power) || plan->finish_us[i] >= 0 || plan->ready_us[i] < 0 ||
+                requests[i].deadline_us > due_us)
+            {
+                continue;
+            }
+            int32_t ready_us = plan->ready_us[i] > plan->total_us ? plan->ready_us[i] : plan->total_us;
+            if (ready_us < next_ready_us ||
+                (ready_us == next_ready_us && requests[i].deadline_us < requests[next].deadline_us))
+            {
+                next = i;
+                next_ready_us = ready_us;
+            }
+        }
+        if (next < 0)
+        {
+            break;
+        }
+        _wait(plan, next_ready_us, false);
+        _read(plan, requests, next);
+    }
+}
+
+static void _convert(DS18B20_Plan *plan, const DS18B20_PlanRequest *requests, int request)
+{
+    const DS18B20_Info *device = requests[request].device;
+    _step(plan, DS18B20_STEP_CONVERT, request, plan->total_us);
+    plan->total_us += _convert_us(device);
+    plan->bus_us += _convert_us(device);
+    plan->ready_us[request] = plan->total_us + ds18b20_plan_conversion_us(device);
+    if (ds18b20_is_parasitic(device))
+    {
+        // the strong pull-up holds the bus, read before the next conversion
+        _wait(plan, plan->ready_us[request], true);
+        _read(plan, requests, request);
+    }
+}
+
+static void _simulate(DS18B20_Plan *plan, const DS18B20_PlanRequest *requests, int count, DS18B20_STRATEGY strategy)
+{
+    plan->strategy = strategy;
+    plan->count = count;
+    plan->step_count = 0;
+    plan->missed = 0;
+    plan->total_us = 0;
+    plan->bus_us = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        plan->ready_us[i] = -1;
+        plan->finish_us[i] = -1;
+    }
+
+    int next = -1;
+    switch (strategy)
+    {
+    case DS18B20_STRATEGY_CONVERT_ALL:
+        _convert_all(plan, requests, POWER_ANY);
+        break;
+    case DS18B20_STRATEGY_EXTERNAL_FIRST:
+        while ((next = _earliest_deadline(plan, requests, POWER_EXTERNAL, false)) >= 0)
+        {
+            _convert(plan, requests, next);
+        }
+        _read_converted(plan, requests, POWER_EXTERNAL, INT32_MAX);
+        _convert_all(plan, requests, POWER_PARASITIC);
+        break;
+    case DS18B20_STRATEGY_ADDRESSED:
+        while ((next = _earliest_deadline(plan, requests, POWER_ANY, false)) >= 0)
+        {
+            if (ds18b20_is_parasitic(requests[next].device))
+            {
+                // the conversion will hold the bus, so first read the devices that are due sooner
+                _read_converted(plan, requests, POWER_EXTERNAL, requests[next].deadline_us);
+            }
+            _convert(plan, requests, next);
+        }
+        break;
+    }
+    _read_converted(plan, requests, POWER_ANY, INT32_MAX);
+}
+
+static bool _better(const DS18B20_Plan *plan, int best_missed, int32_t best_bus_us, int32_t best_total_us)
+{
+    if (plan->missed != best_missed)
+    {
+        return plan->missed < best_missed;
+    }
+    // when every deadline is met the bus time counts, otherwise finishing sooner does
+    if (plan->missed == 0 && plan->bus_us != best_bus_us)
+    {
+        return plan->bus_us < best_bus_us;
+    }
+    return plan->total_us < best_total_us;
+}
+
+int32_t ds18b20_plan_conversion_us(const DS18B20_Info *device)
+{
+    return (int32_t)ds18b20_conversion_time_us(device);
+}
+
+DS18B20_ERROR ds18b20_plan_build(const DS18B20_PlanRequest *requests, int count, DS18B20_Plan *plan)
+{
+    if (requests == NULL || plan == NULL)
+    {
+        ESP_LOGE(TAG, "requests or plan is NULL");
+        return DS18B20_ERROR_NULL;
+    }
+    if (count <= 0 || count > DS18B20_PLAN_MAX_DEVICES)
+    {
+        ESP_LOGE(TAG, "plan must hold 1 to %d devices", DS18B20_PLAN_MAX_DEVICES);
+        return DS18B20_ERROR_PARAM;
+    }
+    bool parasitic = false;
+    bool external = false;
+    for (int i = 0; i < count; ++i)
+    {
+        if (requests[i].device == NULL || !requests[i].device->init)
+        {
+            ESP_LOGE(TAG, "request %d has no initialised device", i);
+            return DS18B20_ERROR_PARAM;
+        }
+        parasitic |= ds18b20_is_parasitic(requests[i].device);
+        external |= !ds18b20_is_parasitic(requests[i].device);
+    }
+
+    // with one power mode only, converting the whole bus at once is never slower and always
+    // cheaper than addressed conversions, except that parasitic devices then all wait for the slowest
+    DS18B20_STRATEGY candidates[3] = {DS18B20_STRATEGY_CONVERT_ALL};
+    int candidate_count = 1;
+    if (parasitic)
+    {
+        candidates[candidate_count++] = DS18B20_STRATEGY_ADDRESSED;
+        if (external)
+        {
+            candidates[candidate_count++] = DS18B20_STRATEGY_EXTERNAL_FIRST;
+        }
+    }
+
+    DS18B20_STRATEGY best = DS18B20_STRATEGY_CONVERT_ALL;
+    _simulate(plan, requests, count, best);
+    int best_missed = plan->missed;
+    int32_t best_bus_us = plan->bus_us;
+    int32_t best_total_us = plan->total_us;
+    for (int i = 1; i < candidate_count; ++i)
+    {
+        _simulate(plan, requests, count, candidates[i]);
+        if (_better(plan, best_missed, best_bus_us, best_total_us))
+        {
+            best = candidates[i];
+            best_missed = plan->missed;
+            best_bus_us = plan->bus_us;
+            best_total_us = plan->total_us;
+        }
+    }
+    if (plan->strategy != best)
+    {
+        _simulate(plan, requests, count, best);
+    }
+    ESP_LOGD(TAG, "planned strategy %d: %d steps, %d us, %d us on the bus, %d missed", plan->strategy,
+             plan->step_count, plan->total_us, plan->bus_us, plan->missed);
+    return plan->missed == 0 ? DS18B20_OK : DS18B20_ERROR_TIMEOUT;
+}
+
+void ds18b20_plan_log(const DS18B20_Plan *plan)
+{
+    static const char *names[] = {"convert all", "convert", "wait", "read"};
+    ESP_LOGI(TAG, "plan: strategy %d, %d us, %d us on the bus, %d missed", plan->strategy, plan->total_us,
+             plan->bus_us, plan->missed);
+    for (int i = 0; i < plan->step_count; ++i)
+    {
+        const DS18B20_PlanStep *step = &plan->steps[i];
+        ESP_LOGI(TAG, "  %8d us  %-11s %d", step->at_us, names[step->type], step->request);
+    }
+}
+
+#endif // CONFIG_TEMP_PLANNER
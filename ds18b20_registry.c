@@ -0,0 +1,248 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_registry.c
+ *
+ * The hash table has at least twice as many slots as the registry capacity and uses linear
+ * probing, so lookups touch one or two slots on average. ROM codes are mixed with a
+ * multiplicative hash because the family code byte is the same for every DS18B20.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_system.h"
+#include "esp_log.h"
+
+#include "ds18b20_registry.h"
+
+#ifdef CONFIG_TEMP_REGISTRY
+
+static const char *TAG = CONFIG_TEMP_TAG; ///< tag for logging
+
+static const uint8_t REGISTRY_MAGIC[4] = {'D', 'S', 'R', '1'}; ///< start of a registry configuration blob
+
+static uint64_t _key(OneWireBus_ROMCode rom_code)
+{
+    uint64_t key = 0;
+    for (int i = sizeof(rom_code.bytes) - 1; i >= 0; --i)
+    {
+        key = (key << 8) | rom_code.bytes[i];
+    }
+    return key;
+}
+
+static int _home_slot(const DS18B20_Registry *registry, uint64_t key)
+{
+    // Fibonacci hashing: the top log2(slot_count) bits of the product depend on every bit of the key
+    int bits = __builtin_ctz(registry->slot_count);
+    return bits == 0 ? 0 : (int)((key * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+static int _find_slot(const DS18B20_Registry *registry, OneWireBus_ROMCode rom_code)
+{
+    uint64_t key = _key(rom_code);
+    int slot = _home_slot(registry, key);
+    while (registry->slots[slot] >= 0 && _key(registry->entries[registry->slots[slot]].rom_code) != key)
+    {
+        slot = (slot + 1) & (registry->slot_count - 1);
+    }
+    return slot;
+}
+
+static void _copy_text(char *destination, const char *source, size_t length)
+{
+    size_t copy = length < DS18B20_REGISTRY_TEXT_LENGTH - 1 ? length : DS18B20_REGISTRY_TEXT_LENGTH - 1;
+    memcpy(destination, source, copy);
+    destination[copy] = '\0';
+}
+
+// Public API
+
+DS18B20_Registry *ds18b20_registry_malloc(int capacity)
+{
+    DS18B20_Registry *registry = NULL;
+    if (capacity > 0 && capacity <= INT16_MAX / 2)
+    {
+        registry = malloc(sizeof(*registry));
+    }
+    if (registry != NULL)
+    {
+        memset(registry, 0, sizeof(*registry));
+        registry->capacity = capacity;
+        registry->slot_count = 1;
+        while (registry->slot_count < 2 * capacity)
+        {
+            registry->slot_count <<= 1;
+        }
+        registry->entries = calloc(capacity, sizeof(*registry->entries));
+        registry->slots = malloc(registry->slot_count * sizeof(*registry->slots));
+        if (registry->entries != NULL && registry->slots != NULL)
+        {
+            memset(registry->slots, 0xff, registry->slot_count * sizeof(*registry->slots));
+            ESP_LOGD(TAG, "registry malloc %p, %d entries, %d slots", registry, capacity, registry->slot_count);
+        }
+        else
+        {
+            ESP_LOGE(TAG, "registry malloc failed");
+            ds18b20_registry_free(&registry);
+        }
+    }
+    else
+    {
+        ESP_LOGE(TAG, "registry malloc failed for %d entries", capacity);
+    }
+    return registry;
+}
+
+void ds18b20_registry_free(DS18B20_Registry **registry)
+{
+    if (registry != NULL && (*registry != NULL))
+    {
+        ESP_LOGD(TAG, "registry free %p", *registry);
+        free((*registry)->entries);
+        free((*registry)->slots);
+        free(*registry);
+        *registry = NULL;
+    }
+}
+
+DS18B20_ERROR ds18b20_registry_add(DS18B20_Registry *registry, OneWireBus_ROMCode rom_code, uint16_t index,
+                                   const char *name, const char *location)
+{
+    if (registry == NULL)
+    {
+        return DS18B20_ERROR_NULL;
+    }
+    if (registry->count >= registry->capacity)
+    {
+        ESP_LOGE(TAG, "registry full");
+        return DS18B20_ERROR_PARAM;
+    }
+
+    int slot = _find_slot(registry, rom_code);
+    if (registry->slots[slot] >= 0)
+    {
+        char rom_code_s[OWB_ROM_CODE_STRING_LENGTH];
+        owb_string_from_rom_code(rom_code, rom_code_s, sizeof(rom_code_s));
+        ESP_LOGE(TAG, "device %s already registered", rom_code_s);
+        return DS18B20_ERROR_PARAM;
+    }
+
+    DS18B20_RegistryEntry *entry = &registry->entries[registry->count];
+    entry->rom_code = rom_code;
+    entry->index = index;
+    _copy_text(entry->name, name ? name : "", name ? strlen(name) : 0);
+    _copy_text(entry->location, location ? location : "", location ? strlen(location) : 0);
+    registry->slots[slot] = registry->count++;
+    return DS18B20_OK;
+}
+
+DS18B20_ERROR ds18b20_registry_load(DS18B20_Registry *registry, const uint8_t *blob, size_t length)
+{
+    if (registry == NULL || blob == NULL)
+    {
+        return DS18B20_ERROR_NULL;
+    }
+    if (length < sizeof(REGISTRY_MAGIC) + 2 || memcmp(blob, REGISTRY_MAGIC, sizeof(REGISTRY_MAGIC)) != 0)
+    {
+        ESP_LOGE(TAG, "not a registry blob");
+        return DS18B20_ERROR_PARAM;
+    }
+
+    size_t offset = sizeof(REGISTRY_MAGIC);
+    int count = blob[offset] | (blob[offset + 1] << 8);
+    offset += 2;
+
+    DS18B20_ERROR err = DS18B20_OK;
+    for (int i = 0; i < count && err == DS18B20_OK; ++i)
+    {
+        OneWireBus_ROMCode rom_code;
+        const char *text[2] = {NULL, NULL};
+        size_t text_length[2] = {0, 0};
+
+        if (offset + sizeof(rom_code.bytes) + 2 > length)
+        {
+            err = DS18B20_ERROR_PARAM;
+            break;
+        }
+        memcpy(rom_code.bytes, &blob[offset], sizeof(rom_code.bytes));
+        offset += sizeof(rom_code.bytes);
+        uint16_t index = blob[offset] | (blob[offset + 1] << 8);
+        offset += 2;
+
+        for (int t = 0; t < 2 && err == DS18B20_OK; ++t)
+        {
+            if (offset + 1 > length || offset + 1 + blob[offset] > length)
+            {
+                err = DS18B20_ERROR_PARAM;
+                break;
+            }
+            text_length[t] = blob[offset];
+            text[t] = (const char *)&blob[offset + 1];
+            offset += 1 + text_length[t];
+        }
+
+        if (err == DS18B20_OK)
+        {
+            err = ds18b20_registry_add(registry, rom_code, index, NULL, NULL);
+        }
+        if (err == DS18B20_OK)
+        {
+            DS18B20_RegistryEntry *entry = &registry->entries[registry->count - 1];
+            _copy_text(entry->name, text[0], text_length[0]);
+            _copy_text(entry->location, text[1], text_length[1]);
+        }
+    }
+
+    if (err != DS18B20_OK)
+    {
+        ESP_LOGE(TAG, "registry blob invalid at offset %u", (unsigned)offset);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "registry loaded %d devices", count);
+    }
+    return err;
+}
+
+const DS18B20_RegistryEntry *ds18b20_registry_lookup(const DS18B20_Registry *registry, OneWireBus_ROMCode rom_code)
+{
+    const DS18B20_RegistryEntry *entry = NULL;
+    if (registry != NULL)
+    {
+        int slot = _find_slot(registry, rom_code);
+        if (registry->slots[slot] >= 0)
+        {
+            entry = &registry->entries[registry->slots[slot]];
+        }
+    }
+    return entry;
+}
+
+#endif // CONFIG_TEMP_REGISTRY
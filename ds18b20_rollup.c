@@ -0,0 +1,336 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_rollup.c
+ *
+ * Each level maps bucket number (time / width) to a slot in its ring. A slot is reset the first
+ * time a newer bucket number lands on it, so old buckets are overwritten in place and the rollup
+ * never allocates after creation.
+ *
+ * A query takes whole buckets from the coarsest level that fits and hands the edges down to the
+ * finer levels. An edge that starts before the finer level's retention is taken from the coarse
+ * buckets overlapping it instead, so old readings are never silently dropped; the result is then
+ * flagged approximate, as those buckets may hold readings just outside the range.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_system.h"
+#include "esp_log.h"
+
+#include "ds18b20_rollup.h"
+
+#ifdef CONFIG_TEMP_ROLLUP
+
+static const char *TAG = CONFIG_TEMP_TAG; ///< tag for logging
+
+static const int16_t RAW_MIN = -55 * 16; ///< lowest reading the device can report
+static const int16_t RAW_MAX = 125 * 16; ///< highest reading the device can report
+
+/// @cond ignore
+typedef struct
+{
+    int16_t min;
+    int16_t max;
+    int64_t sum;
+    uint32_t count;
+    bool approximate;
+} Accumulator;
+/// @endcond ignore
+
+static const DS18B20_RollupBucket *_lookup(const DS18B20_RollupLevel *level, int device, int64_t bucket_number)
+{
+    int slot = bucket_number % level->length;
+    if (level->bucket_numbers[slot] != bucket_number)
+    {
+        return NULL;
+    }
+    return &level->buckets[device * level->length + slot];
+}
+
+static void _merge(Accumulator *accumulator, const DS18B20_RollupBucket *bucket)
+{
+    if (bucket != NULL && bucket->count > 0)
+    {
+        if (accumulator->count == 0 || bucket->min < accumulator->min)
+        {
+            accumulator->min = bucket->min;
+        }
+        if (accumulator->count == 0 || bucket->max > accumulator->max)
+        {
+            accumulator->max = bucket->max;
+        }
+        accumulator->sum += bucket->sum;
+        accumulator->count += bucket->count;
+    }
+}
+
+static void _merge_range(const DS18B20_RollupLevel *level, int device, int64_t first, int64_t end, Accumulator *accumulator)
+{
+    // buckets outside the ring cannot be held, so skip straight to the retained ones
+    int64_t oldest = level->newest - level->length + 1;
+    first = first > oldest ? first : oldest;
+    end = end < level->newest + 1 ? end : level->newest + 1;
+    for (int64_t b = first; b < end; ++b)
+    {
+        _merge(accumulator, _lookup(level, device, b));
+    }
+}
+
+static void _query(const DS18B20_Rollup *rollup, int level_index, int device, int64_t from_ms, int64_t to_ms,
+                   Accumulator *accumulator);
+
+/**
+ * Aggregate part of a range that holds no whole bucket of the level, with the finer levels if they
+ * still retain its start, otherwise with the buckets of the level that overlap it.
+ */
+static void _query_edge(const DS18B20_Rollup *rollup, int level_index, int device, int64_t from_ms, int64_t to_ms,
+                        Accumulator *accumulator)
+{
+    if (from_ms >= to_ms)
+    {
+        return;
+    }
+
+    const DS18B20_RollupLevel *finer = &rollup->levels[level_index - 1];
+    int64_t retained_ms = (finer->newest - finer->length + 1) * (int64_t)finer->width_ms;
+    if (from_ms >= retained_ms)
+    {
+        _query(rollup, level_index - 1, device, from_ms, to_ms, accumulator);
+        return;
+    }
+
+    const DS18B20_RollupLevel *level = &rollup->levels[level_index];
+    int64_t width = level->width_ms;
+    uint32_t count = accumulator->count;
+    _merge_range(level, device, from_ms / width, (to_ms + width - 1) / width, accumulator);
+    accumulator->approximate |= accumulator->count != count;
+}
+
+static void _query(const DS18B20_Rollup *rollup, int level_index, int device, int64_t from_ms, int64_t to_ms,
+                   Accumulator *accumulator)
+{
+    if (from_ms >= to_ms)
+    {
+        return;
+    }
+
+    const DS18B20_RollupLevel *level = &rollup->levels[level_index];
+    int64_t width = level->width_ms;
+    if (level_index == 0)
+    {
+        // finest level: include every bucket touching the range
+        _merge_range(level, device, from_ms / width, (to_ms + width - 1) / width, accumulator);
+        return;
+    }
+
+    int64_t first = (from_ms + width - 1) / width; // first bucket starting inside the range
+    int64_t end = to_ms / width;                   // first bucket ending outside the range
+    if (first >= end)
+    {
+        _query_edge(rollup, level_index, device, from_ms, to_ms, accumulator);
+    }
+    else
+    {
+        _query_edge(rollup, level_index, device, from_ms, first * width, accumulator);
+        _merge_range(level, device, first, end, accumulator);
+        _query_edge(rollup, level_index, device, end * width, to_ms, accumulator);
+    }
+}
+
+// Public API
+
+DS18B20_Rollup *ds18b20_rollup_malloc(int devices)
+{
+    static const uint32_t widths[DS18B20_ROLLUP_LEVELS] = {1000, 60 * 1000, 60 * 60 * 1000};
+    static const int lengths[DS18B20_ROLLUP_LEVELS] = {CONFIG_TEMP_ROLLUP_SECONDS, CONFIG_TEMP_ROLLUP_MINUTES,
+                                                       CONFIG_TEMP_ROLLUP_HOURS};
+
+    DS18B20_Rollup *rollup = NULL;
+    if (devices > 0)
+    {
+        rollup = malloc(sizeof(*rollup));
+    }
+    if (rollup != NULL)
+    {
+        memset(rollup, 0, sizeof(*rollup));
+        rollup->devices = devices;
+        bool ok = true;
+        for (int i = 0; i < DS18B20_ROLLUP_LEVELS; ++i)
+        {
+            DS18B20_RollupLevel *level = &rollup->levels[i];
+            level->width_ms = widths[i];
+            level->length = lengths[i];
+            level->newest = -1;
+            level->bucket_numbers = malloc(level->length * sizeof(*level->bucket_numbers));
+            level->buckets = calloc(devices * level->length, sizeof(*level->buckets));
+            if (level->bucket_numbers == NULL || level->buckets == NULL)
+            {
+                ok = false;
+                break;
+            }
+            for (int slot = 0; slot < level->length; ++slot)
+            {
+                level->bucket_numbers[slot] = -1;
+            }
+        }
+
+        if (ok)
+        {
+            ESP_LOGD(TAG, "rollup malloc %p for %d devices", rollup, devices);
+        }
+        else
+        {
+            ESP_LOGE(TAG, "rollup malloc failed");
+            ds18b20_rollup_free(&rollup);
+        }
+    }
+    else
+    {
+        ESP_LOGE(TAG, "rollup malloc failed for %d devices", devices);
+    }
+    return rollup;
+}
+
+void ds18b20_rollup_free(DS18B20_Rollup **rollup)
+{
+    if (rollup != NULL && (*rollup != NULL))
+    {
+        ESP_LOGD(TAG, "rollup free %p", *rollup);
+        for (int i = 0; i < DS18B20_ROLLUP_LEVELS; ++i)
+        {
+            free((*rollup)->levels[i].bucket_numbers);
+            free((*rollup)->levels[i].buckets);
+        }
+        free(*rollup);
+        *rollup = NULL;
+    }
+}
+
+size_t ds18b20_rollup_size(const DS18B20_Rollup *rollup)
+{
+    size_t size = 0;
+    if (rollup != NULL)
+    {
+        size = sizeof(*rollup);
+        for (int i = 0; i < DS18B20_ROLLUP_LEVELS; ++i)
+        {
+            const DS18B20_RollupLevel *level = &rollup->levels[i];
+            size += level->length * (sizeof(*level->bucket_numbers) + rollup->devices * sizeof(*level->buckets));
+        }
+    }
+    return size;
+}
+
+void ds18b20_rollup_add(DS18B20_Rollup *rollup, int64_t time_ms, const int16_t *values,
+                        const DS18B20_ERROR *errors, int count)
+{
+    if (rollup == NULL || values == NULL)
+    {
+        ESP_LOGE(TAG, "rollup or values is NULL");
+        return;
+    }
+    if (time_ms < 0)
+    {
+        ESP_LOGE(TAG, "rollup time must not be negative");
+        return;
+    }
+    count = count < rollup->devices ? count : rollup->devices;
+
+    for (int i = 0; i < DS18B20_ROLLUP_LEVELS; ++i)
+    {
+        DS18B20_RollupLevel *level = &rollup->levels[i];
+        int64_t bucket_number = time_ms / level->width_ms;
+        int slot = bucket_number % level->length;
+        if (level->bucket_numbers[slot] > bucket_number)
+        {
+            // the slot already holds a newer bucket
+            continue;
+        }
+        if (level->bucket_numbers[slot] != bucket_number)
+        {
+            level->bucket_numbers[slot] = bucket_number;
+            for (int device = 0; device < rollup->devices; ++device)
+            {
+                memset(&level->buckets[device * level->length + slot], 0, sizeof(DS18B20_RollupBucket));
+            }
+        }
+        level->newest = bucket_number > level->newest ? bucket_number : level->newest;
+
+        for (int device = 0; device < count; ++device)
+        {
+            int16_t value = values[device];
+            if ((errors != NULL && errors[device] != DS18B20_OK) || value < RAW_MIN || value > RAW_MAX)
+            {
+                continue;
+            }
+            DS18B20_RollupBucket *bucket = &level->buckets[device * level->length + slot];
+            if (bucket->count == 0 || value < bucket->min)
+            {
+                bucket->min = value;
+            }
+            if (bucket->count == 0 || value > bucket->max)
+            {
+                bucket->max = value;
+            }
+            bucket->sum += value;
+            ++bucket->count;
+        }
+    }
+}
+
+DS18B20_ERROR ds18b20_rollup_query(const DS18B20_Rollup *rollup, int device, int64_t from_ms, int64_t to_ms,
+                                   DS18B20_RollupStats *stats)
+{
+    if (rollup == NULL || stats == NULL)
+    {
+        return DS18B20_ERROR_NULL;
+    }
+    if (device < 0 || device >= rollup->devices || from_ms < 0)
+    {
+        ESP_LOGE(TAG, "invalid rollup query for device %d", device);
+        return DS18B20_ERROR_PARAM;
+    }
+
+    Accumulator accumulator = {0};
+    _query(rollup, DS18B20_ROLLUP_LEVELS - 1, device, from_ms, to_ms, &accumulator);
+
+    memset(stats, 0, sizeof(*stats));
+    if (accumulator.count > 0)
+    {
+        stats->min = accumulator.min;
+        stats->max = accumulator.max;
+        stats->mean = accumulator.sum / (int64_t)accumulator.count;
+        stats->count = accumulator.count;
+        stats->approximate = accumulator.approximate;
+    }
+    return DS18B20_OK;
+}
+
+#endif // CONFIG_TEMP_ROLLUP
@@ -0,0 +1,591 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_sim.c
+ *
+ * Every device runs its own copy of the 1-Wire protocol state machine. Write time slots are
+ * delivered to all attached devices, and a read time slot returns the wired-AND of what each
+ * device drives, so searches and Skip ROM commands behave as on a real bus.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "ds18b20_sim.h"
+
+#ifdef CONFIG_TEMP_SIM
+
+static const char *TAG = CONFIG_TEMP_TAG; ///< tag for logging
+
+#define SIM_RESET_US 960       ///< nominal duration of a reset and presence detect
+#define SIM_SLOT_US 70         ///< nominal duration of a read or write time slot
+#define SIM_CONVERSION_US 750000 ///< datasheet maximum conversion time at 12-bit resolution
+#define SIM_FAMILY_DS18B20 0x28  ///< family code of the DS18B20
+
+// Function commands, as in ds18b20.c
+#define SIM_TEMP_CONVERT 0x44
+#define SIM_SCRATCHPAD_WRITE 0x4E
+#define SIM_SCRATCHPAD_READ 0xBE
+#define SIM_SCRATCHPAD_COPY 0x48
+#define SIM_EEPROM_RECALL 0xB8
+#define SIM_POWER_SUPPLY_READ 0xB4
+
+/// protocol states of a simulated device
+enum
+{
+    SIM_IDLE,               ///< reset, waiting for a ROM command
+    SIM_MATCH,              ///< receiving the ROM code of a Match ROM
+    SIM_SEARCH,             ///< taking part in a search
+    SIM_FUNCTION,           ///< selected, waiting for a function command
+    SIM_WRITE_SCRATCHPAD,   ///< receiving TH, TL and configuration
+    SIM_SEND,               ///< sending data to the master
+    SIM_CONVERTING,         ///< converting, holds read slots low until done unless parasitic
+    SIM_DONE,               ///< not selected or finished, ignores the bus until the next reset
+};
+
+static const uint8_t POWER_ON_SCRATCHPAD[8] = {0x50, 0x05, 0x4b, 0x46, 0x7f, 0xff, 0x0c, 0x10}; ///< datasheet power-on state
+
+static uint32_t _random(DS18B20_Sim *sim)
+{
+    // xorshift32, repeatable for a given seed
+    uint32_t x = sim->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim->random = x;
+    return x;
+}
+
+static bool _chance(DS18B20_Sim *sim, uint32_t ppm)
+{
+    return ppm > 0 && _random(sim) % 1000000u < ppm;
+}
+
+static int64_t _now_us(const DS18B20_Sim *sim)
+{
+    return esp_timer_get_time() - sim->start_us + sim->slot_time_us;
+}
+
+static bool _attached(const DS18B20_SimDevice *device, int64_t now_us)
+{
+    return device->present && now_us >= device->absent_until_us;
+}
+
+static void _set_crc(DS18B20_SimDevice *device)
+{
+    device->scratchpad[8] = owb_crc8_bytes(0, device->scratchpad, 8);
+}
+
+static void _power_on(DS18B20_SimDevice *device)
+{
+    memcpy(device->scratchpad, POWER_ON_SCRATCHPAD, sizeof(POWER_ON_SCRATCHPAD));
+    memcpy(&device->scratchpad[2], device->eeprom, sizeof(device->eeprom));
+    _set_crc(device);
+    device->state = SIM_DONE;
+}
+
+static int _resolution(const DS18B20_SimDevice *device)
+{
+    return 9 + ((device->scratchpad[4] >> 5) & 0x03);
+}
+
+static void _store_temperature(DS18B20_SimDevice *device, int16_t raw)
+{
+    // undefined low bits read as zero at reduced resolution
+    raw &= ~((1 << (12 - _resolution(device))) - 1);
+    device->scratchpad[0] = raw & 0xff;
+    device->scratchpad[1] = (raw >> 8) & 0xff;
+    device->scratchpad[6] = 0x10 - (raw & 0x0f);
+    _set_crc(device);
+}
+
+static void _settle(DS18B20_Sim *sim, DS18B20_SimDevice *device, int64_t now_us, bool bus_activity)
+{
+    if (!device->converting)
+    {
+        return;
+    }
+    if (now_us >= device->conversion_end_us)
+    {
+        device->converting = false;
+        if (_chance(sim, sim->faults.power_on_ppm))
+        {
+            ++sim->stats.power_on_values;
+            _power_on(device);
+        }
+        else
+        {
+            _store_temperature(device, device->temperature);
+        }
+        device->state = device->state == SIM_CONVERTING ? SIM_DONE : device->state;
+    }
+    else if (bus_activity && device->parasitic)
+    {
+        // the bus is pulled low before the conversion completes, starving a parasitic device
+        ESP_LOGD(TAG, "sim: parasitic conversion interrupted");
+        device->converting = false;
+        ++sim->stats.power_on_values;
+        _power_on(device);
+    }
+}
+
+static void _start_send(DS18B20_SimDevice *device, const uint8_t *data, int bits, uint8_t next_state)
+{
+    device->state = SIM_SEND;
+    device->next_state = next_state;
+    device->send = data;
+    device->send_bits = bits;
+    device->bit_index = 0;
+}
+
+static bool _alarm(const DS18B20_SimDevice *device)
+{
+    int8_t degrees = (int16_t)(device->scratchpad[0] | (device->scratchpad[1] << 8)) >> 4;
+    return degrees >= (int8_t)device->scratchpad[2] || degrees <= (int8_t)device->scratchpad[3];
+}
+
+static void _rom_command(DS18B20_SimDevice *device, uint8_t command)
+{
+    device->bit_index = 0;
+    device->byte = 0;
+    switch (command)
+    {
+    case OWB_ROM_SKIP:
+        device->state = SIM_FUNCTION;
+        break;
+    case OWB_ROM_MATCH:
+        device->state = SIM_MATCH;
+        break;
+    case OWB_ROM_READ:
+        _start_send(device, device->rom_code.bytes, 64, SIM_FUNCTION);
+        break;
+    case OWB_ROM_SEARCH_ALARM:
+        if (!_alarm(device))
+        {
+            device->state = SIM_DONE;
+            break;
+        }
+        // fall through
+    case OWB_ROM_SEARCH:
+        device->state = SIM_SEARCH;
+        device->search_phase = 0;
+        break;
+    default:
+        device->state = SIM_DONE;
+        break;
+    }
+}
+
+static void _function_command(DS18B20_Sim *sim, DS18B20_SimDevice *device, uint8_t command, int64_t now_us)
+{
+    device->bit_index = 0;
+    device->byte = 0;
+    switch (command)
+    {
+    case SIM_TEMP_CONVERT:
+    {
+        int64_t duration_us = (SIM_CONVERSION_US >> (12 - _resolution(device))) * device->conversion_percent / 100;
+        device->conversion_end_us = now_us + duration_us;
+        device->state = SIM_CONVERTING;
+        device->converting = true;
+        break;
+    }
+    case SIM_SCRATCHPAD_READ:
+        _start_send(device, device->scratchpad, 8 * sizeof(device->scratchpad), SIM_DONE);
+        break;
+    case SIM_SCRATCHPAD_WRITE:
+        device->state = SIM_WRITE_SCRATCHPAD;
+        break;
+    case SIM_SCRATCHPAD_COPY:
+        memcpy(device->eeprom, &device->scratchpad[2], sizeof(device->eeprom));
+        device->state = SIM_DONE;
+        break;
+    case SIM_EEPROM_RECALL:
+        memcpy(&device->scratchpad[2], device->eeprom, sizeof(device->eeprom));
+        _set_crc(device);
+        device->state = SIM_DONE;
+        break;
+    case SIM_POWER_SUPPLY_READ:
+        // parasitic devices pull the bus low during the read slot
+        device->power_bit = device->parasitic ? 0x00 : 0x01;
+        _start_send(device, &device->power_bit, 1, SIM_DONE);
+        break;
+    default:
+        ESP_LOGD(TAG, "sim: unknown function command 0x%02x", command);
+        device->state = SIM_DONE;
+        break;
+    }
+}
+
+static uint8_t _rom_bit(const DS18B20_SimDevice *device)
+{
+    return (device->rom_code.bytes[device->bit_index / 8] >> (device->bit_index % 8)) & 0x01;
+}
+
+static void _write_bit(DS18B20_Sim *sim, DS18B20_SimDevice *device, uint8_t bit, int64_t now_us)
+{
+    switch (device->state)
+    {
+    case SIM_IDLE:
+    case SIM_FUNCTION:
+    case SIM_WRITE_SCRATCHPAD:
+        device->byte |= bit << (device->bit_index % 8);
+        if (++device->bit_index % 8 == 0)
+        {
+            uint8_t byte = device->byte;
+            device->byte = 0;
+            if (device->state == SIM_IDLE)
+            {
+                _rom_command(device, byte);
+            }
+            else if (device->state == SIM_FUNCTION)
+            {
+                _function_command(sim, device, byte, now_us);
+            }
+            else
+            {
+                int index = 2 + device->bit_index / 8 - 1;
+                device->scratchpad[index] = index == 4 ? (byte & 0x60) | 0x1f : byte;
+                _set_crc(device);
+                if (index == 4)
+                {
+                    device->state = SIM_DONE;
+                }
+            }
+        }
+        break;
+    case SIM_MATCH:
+        if (bit != _rom_bit(device))
+        {
+            device->state = SIM_DONE;
+        }
+        else if (++device->bit_index == 64)
+        {
+            device->state = SIM_FUNCTION;
+            device->bit_index = 0;
+        }
+        break;
+    case SIM_SEARCH:
+        if (device->search_phase == 2)
+        {
+            if (bit != _rom_bit(device))
+            {
+                device->state = SIM_DONE;
+            }
+            else if (++device->bit_index == 64)
+            {
+                device->state = SIM_FUNCTION;
+                device->bit_index = 0;
+            }
+            device->search_phase = 0;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static uint8_t _read_bit(DS18B20_SimDevice *device)
+{
+    uint8_t bit = 0x01;
+    switch (device->state)
+    {
+    case SIM_SEND:
+        bit = (device->send[device->bit_index / 8] >> (device->bit_index % 8)) & 0x01;
+        if (++device->bit_index == device->send_bits)
+        {
+            device->state = device->next_state;
+            device->bit_index = 0;
+        }
+        break;
+    case SIM_SEARCH:
+        if (device->search_phase < 2)
+        {
+            bit = device->search_phase == 0 ? _rom_bit(device) : !_rom_bit(device);
+            ++device->search_phase;
+        }
+        break;
+    case SIM_CONVERTING:
+        // still converting after _settle, so hold the bus low unless powered from it
+        bit = device->parasitic ? 0x01 : 0x00;
+        break;
+    default:
+        break;
+    }
+    return bit;
+}
+
+static void _run_script(DS18B20_Sim *sim)
+{
+    int64_t now_us = _now_us(sim);
+    while (sim->script_next < sim->script_length && sim->script[sim->script_next].time_us <= now_us)
+    {
+        ds18b20_sim_apply(sim, &sim->script[sim->script_next++]);
+    }
+}
+
+// Driver functions
+
+static owb_status _uninitialize(const OneWireBus *bus)
+{
+    return OWB_STATUS_OK;
+}
+
+static owb_status _reset(const OneWireBus *bus, bool *is_present)
+{
+    DS18B20_Sim *sim = container_of(bus, DS18B20_Sim, bus);
+    _run_script(sim);
+    int64_t now_us = _now_us(sim);
+    sim->slot_time_us += SIM_RESET_US;
+    ++sim->stats.resets;
+
+    bool present = false;
+    for (int i = 0; i < sim->device_count; ++i)
+    {
+        DS18B20_SimDevice *device = &sim->devices[i];
+        _settle(sim, device, now_us, true);
+        if (_attached(device, now_us) && _chance(sim, sim->faults.vanish_ppm))
+        {
+            ++sim->stats.vanished;
+            device->absent_until_us = now_us + sim->faults.vanish_us;
+        }
+        if (_attached(device, now_us))
+        {
+            present = true;
+            device->state = SIM_IDLE;
+            device->bit_index = 0;
+            device->byte = 0;
+        }
+    }
+
+    if (present && (sim->faults.stuck_low || _chance(sim, sim->faults.presence_failure_ppm)))
+    {
+        ++sim->stats.missed_presence;
+        present = false;
+    }
+    *is_present = present && !sim->faults.stuck_low;
+    return OWB_STATUS_OK;
+}
+
+static owb_status _write_bits(const OneWireBus *bus, uint8_t out, int number_of_bits_to_write)
+{
+    DS18B20_Sim *sim = container_of(bus, DS18B20_Sim, bus);
+    if (number_of_bits_to_write > 8)
+    {
+        return OWB_STATUS_TOO_MANY_BITS;
+    }
+    _run_script(sim);
+    for (int b = 0; b < number_of_bits_to_write; ++b)
+    {
+        int64_t now_us = _now_us(sim);
+        sim->slot_time_us += SIM_SLOT_US;
+        ++sim->stats.bits_written;
+
+        uint8_t bit = (out >> b) & 0x01;
+        if (sim->faults.stuck_low)
+        {
+            bit = 0;
+        }
+        else if (_chance(sim, sim->faults.bit_error_ppm))
+        {
+            ++sim->stats.flipped_bits;
+            bit ^= 0x01;
+        }
+        for (int i = 0; i < sim->device_count; ++i)
+        {
+            DS18B20_SimDevice *device = &sim->devices[i];
+            _settle(sim, device, now_us, true);
+            if (_attached(device, now_us))
+            {
+                _write_bit(sim, device, bit, now_us);
+            }
+        }
+    }
+    return OWB_STATUS_OK;
+}
+
+static owb_status _read_bits(const OneWireBus *bus, uint8_t *in, int number_of_bits_to_read)
+{
+    DS18B20_Sim *sim = container_of(bus, DS18B20_Sim, bus);
+    if (number_of_bits_to_read > 8)
+    {
+        return OWB_STATUS_TOO_MANY_BITS;
+    }
+    _run_script(sim);
+    uint8_t result = 0;
+    for (int b = 0; b < number_of_bits_to_read; ++b)
+    {
+        int64_t now_us = _now_us(sim);
+        sim->slot_time_us += SIM_SLOT_US;
+        ++sim->stats.bits_read;
+
+        // wired-AND of every device driving the bus
+        uint8_t bit = 0x01;
+        for (int i = 0; i < sim->device_count; ++i)
+        {
+            DS18B20_SimDevice *device = &sim->devices[i];
+            // a read slot pulls the bus low, which a converting parasitic device cannot survive
+            _settle(sim, device, now_us, true);
+            if (_attached(device, now_us))
+            {
+                bit &= _read_bit(device);
+            }
+        }
+        if (sim->faults.stuck_low)
+        {
+            bit = 0;
+        }
+        else if (_chance(sim, sim->faults.bit_error_ppm))
+        {
+            ++sim->stats.flipped_bits;
+            bit ^= 0x01;
+        }
+        result |= bit << b;
+    }
+    *in = result;
+    return OWB_STATUS_OK;
+}
+
+static const struct owb_driver sim_driver = {
+    .name = "owb_sim",
+    .uninitialize = _uninitialize,
+    .reset = _reset,
+    .write_bits = _write_bits,
+    .read_bits = _read_bits,
+};
+
+// Public API
+
+OneWireBus *ds18b20_sim_initialize(DS18B20_Sim *sim, uint32_t seed)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->bus.driver = &sim_driver;
+    sim->bus.strong_pullup_gpio = GPIO_NUM_NC;
+    sim->random = seed != 0 ? seed : 1; // xorshift never leaves zero
+    sim->start_us = esp_timer_get_time();
+    ESP_LOGD(TAG, "sim bus %p, seed %u", sim, (unsigned)seed);
+    return &sim->bus;
+}
+
+OneWireBus_ROMCode ds18b20_sim_rom_code(uint64_t serial)
+{
+    OneWireBus_ROMCode rom_code;
+    rom_code.fields.family[0] = SIM_FAMILY_DS18B20;
+    for (int i = 0; i < sizeof(rom_code.fields.serial_number); ++i)
+    {
+        rom_code.fields.serial_number[i] = serial >> (8 * i);
+    }
+    rom_code.fields.crc[0] = owb_crc8_bytes(0, rom_code.bytes, 7);
+    return rom_code;
+}
+
+int ds18b20_sim_add_device(DS18B20_Sim *sim, OneWireBus_ROMCode rom_code, bool parasitic, int16_t temperature)
+{
+    if (sim->device_count >= DS18B20_SIM_MAX_DEVICES)
+    {
+        ESP_LOGE(TAG, "sim bus full");
+        return -1;
+    }
+    DS18B20_SimDevice *device = &sim->devices[sim->device_count];
+    memset(device, 0, sizeof(*device));
+    device->rom_code = rom_code;
+    device->present = true;
+    device->parasitic = parasitic;
+    device->temperature = temperature;
+    device->conversion_percent = 100;
+    memcpy(device->eeprom, &POWER_ON_SCRATCHPAD[2], sizeof(device->eeprom));
+    _power_on(device);
+    return sim->device_count++;
+}
+
+void ds18b20_sim_set_faults(DS18B20_Sim *sim, const DS18B20_SimFaults *faults)
+{
+    sim->faults = *faults;
+}
+
+void ds18b20_sim_set_script(DS18B20_Sim *sim, const DS18B20_SimEvent *script, int length)
+{
+    sim->script = script;
+    sim->script_length = script != NULL ? length : 0;
+    sim->script_next = 0;
+}
+
+void ds18b20_sim_apply(DS18B20_Sim *sim, const DS18B20_SimEvent *event)
+{
+    DS18B20_SimDevice *device = NULL;
+    if (event->device >= 0 && event->device < sim->device_count)
+    {
+        device = &sim->devices[event->device];
+    }
+
+    switch (event->action)
+    {
+    case DS18B20_SIM_SET_BIT_ERROR_PPM:
+        sim->faults.bit_error_ppm = event->value;
+        break;
+    case DS18B20_SIM_SET_PRESENCE_FAILURE_PPM:
+        sim->faults.presence_failure_ppm = event->value;
+        break;
+    case DS18B20_SIM_SET_STUCK_LOW:
+        sim->faults.stuck_low = event->value != 0;
+        break;
+    default:
+        if (device == NULL)
+        {
+            ESP_LOGE(TAG, "sim: no device %d", event->device);
+        }
+        else if (event->action == DS18B20_SIM_SET_PRESENT)
+        {
+            device->present = event->value != 0;
+            device->state = SIM_DONE;
+        }
+        else if (event->action == DS18B20_SIM_SET_TEMPERATURE)
+        {
+            device->temperature = event->value;
+        }
+        else if (event->action == DS18B20_SIM_SET_CONVERSION_PERCENT)
+        {
+            device->conversion_percent = event->value;
+        }
+        else if (event->action == DS18B20_SIM_POWER_ON_RESET)
+        {
+            _power_on(device);
+        }
+        break;
+    }
+}
+
+int64_t ds18b20_sim_time_us(const DS18B20_Sim *sim)
+{
+    return _now_us(sim);
+}
+
+#endif // CONFIG_TEMP_SIM
@@ -0,0 +1,334 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_trace.c
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "ds18b20_trace.h"
+
+#ifdef CONFIG_TEMP_TRACE
+
+static const char *TAG = CONFIG_TEMP_TAG; ///< tag for logging
+
+static const uint8_t TRACE_MAGIC[4] = {'D', 'S', 'T', '1'}; ///< start of a recording
+
+#define TRACE_RESET 0x00u   ///< op type of a reset
+#define TRACE_WRITE 0x40u   ///< op type of a write
+#define TRACE_READ 0x80u    ///< op type of a read
+#define TRACE_TYPE 0xc0u    ///< mask of the op type
+#define TRACE_STATUS 0x20u  ///< op flag: a status byte follows
+#define TRACE_PRESENT 0x10u ///< op flag: a reset found a device
+#define TRACE_BITS 0x07u    ///< mask of the number of bits minus one
+
+/// @cond ignore
+typedef struct
+{
+    uint8_t op;
+    uint32_t delta_us;
+    uint8_t data;
+    owb_status status;
+} TraceRecord;
+/// @endcond ignore
+
+static void _write_record(DS18B20_Trace *trace, uint8_t op, uint8_t data, owb_status status)
+{
+    uint8_t buffer[8];
+    size_t length = 0;
+
+    int64_t now_us = esp_timer_get_time();
+    int64_t delta_us = trace->last_us < 0 ? 0 : now_us - trace->last_us;
+    if (trace->last_us >= 0)
+    {
+        trace->stats.recorded_us += delta_us;
+    }
+    trace->last_us = now_us;
+    uint32_t delta = delta_us > UINT32_MAX ? UINT32_MAX : (uint32_t)delta_us;
+
+    if (status != OWB_STATUS_OK)
+    {
+        op |= TRACE_STATUS;
+    }
+    buffer[length++] = op;
+    do
+    {
+        buffer[length++] = (delta & 0x7f) | (delta > 0x7f ? 0x80 : 0x00);
+        delta >>= 7;
+    } while (delta != 0);
+    if ((op & TRACE_TYPE) != TRACE_RESET)
+    {
+        buffer[length++] = data;
+    }
+    if (status != OWB_STATUS_OK)
+    {
+        buffer[length++] = (uint8_t)status;
+    }
+
+    if (fwrite(buffer, 1, length, trace->file) != length)
+    {
+        ESP_LOGE(TAG, "trace write failed");
+    }
+    trace->stats.bytes += length;
+}
+
+static bool _read_record(DS18B20_Trace *trace, TraceRecord *record)
+{
+    int c = fgetc(trace->file);
+    if (c == EOF)
+    {
+        return false;
+    }
+    record->op = c;
+    record->delta_us = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if ((c = fgetc(trace->file)) == EOF)
+        {
+            return false;
+        }
+        record->delta_us |= (uint32_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+        {
+            break;
+        }
+    }
+    record->data = 0;
+    if ((record->op & TRACE_TYPE) != TRACE_RESET && (c = fgetc(trace->file)) != EOF)
+    {
+        record->data = c;
+    }
+    record->status = OWB_STATUS_OK;
+    if ((record->op & TRACE_STATUS) && (c = fgetc(trace->file)) != EOF)
+    {
+        record->status = (int8_t)c;
+    }
+    if (c == EOF)
+    {
+        return false;
+    }
+    trace->stats.recorded_us += record->delta_us;
+    return true;
+}
+
+/**
+ * read the next record and check that it is the operation the driver is asking for
+ */
+static bool _replay_next(DS18B20_Trace *trace, uint8_t type, int number_of_bits, TraceRecord *record)
+{
+    bool ok = _read_record(trace, record);
+    if (!ok)
+    {
+        ESP_LOGW(TAG, "trace replay: end of recording");
+    }
+    else if ((record->op & TRACE_TYPE) != type ||
+             (type != TRACE_RESET && (record->op & TRACE_BITS) != number_of_bits - 1))
+    {
+        ESP_LOGW(TAG, "trace replay: recorded op 0x%02x, replayed type 0x%02x of %d bits",
+                 record->op, type, number_of_bits);
+        ok = false;
+    }
+    if (!ok)
+    {
+        ++trace->stats.divergences;
+    }
+    return ok;
+}
+
+// Recording driver
+
+static owb_status _record_uninitialize(const OneWireBus *bus)
+{
+    DS18B20_Trace *trace = container_of(bus, DS18B20_Trace, bus);
+    return trace->target->driver->uninitialize(trace->target);
+}
+
+static owb_status _record_reset(const OneWireBus *bus, bool *is_present)
+{
+    DS18B20_Trace *trace = container_of(bus, DS18B20_Trace, bus);
+    owb_status status = trace->target->driver->reset(trace->target, is_present);
+    _write_record(trace, TRACE_RESET | (*is_present ? TRACE_PRESENT : 0), 0, status);
+    ++trace->stats.resets;
+    return status;
+}
+
+static owb_status _record_write_bits(const OneWireBus *bus, uint8_t out, int number_of_bits_to_write)
+{
+    DS18B20_Trace *trace = container_of(bus, DS18B20_Trace, bus);
+    owb_status status = trace->target->driver->write_bits(trace->target, out, number_of_bits_to_write);
+    _write_record(trace, TRACE_WRITE | ((number_of_bits_to_write - 1) & TRACE_BITS), out, status);
+    ++trace->stats.writes;
+    return status;
+}
+
+static owb_status _record_read_bits(const OneWireBus *bus, uint8_t *in, int number_of_bits_to_read)
+{
+    DS18B20_Trace *trace = container_of(bus, DS18B20_Trace, bus);
+    owb_status status = trace->target->driver->read_bits(trace->target, in, number_of_bits_to_read);
+    _write_record(trace, TRACE_READ | ((number_of_bits_to_read - 1) & TRACE_BITS), *in, status);
+    ++trace->stats.reads;
+    return status;
+}
+
+static const struct owb_driver record_driver = {
+    .name = "owb_trace_record",
+    .uninitialize = _record_uninitialize,
+    .reset = _record_reset,
+    .write_bits = _record_write_bits,
+    .read_bits = _record_read_bits,
+};
+
+// Replaying driver
+
+static owb_status _replay_uninitialize(const OneWireBus *bus)
+{
+    return OWB_STATUS_OK;
+}
+
+static owb_status _replay_reset(const OneWireBus *bus, bool *is_present)
+{
+    DS18B20_Trace *trace = container_of(bus, DS18B20_Trace, bus);
+    TraceRecord record;
+    ++trace->stats.resets;
+    if (!_replay_next(trace, TRACE_RESET, 0, &record))
+    {
+        *is_present = false;
+        return OWB_STATUS_HW_ERROR;
+    }
+    *is_present = (record.op & TRACE_PRESENT) != 0;
+    return record.status;
+}
+
+static owb_status _replay_write_bits(const OneWireBus *bus, uint8_t out, int number_of_bits_to_write)
+{
+    DS18B20_Trace *trace = container_of(bus, DS18B20_Trace, bus);
+    TraceRecord record;
+    ++trace->stats.writes;
+    if (!_replay_next(trace, TRACE_WRITE, number_of_bits_to_write, &record))
+    {
+        return OWB_STATUS_HW_ERROR;
+    }
+    uint8_t mask = (1u << number_of_bits_to_write) - 1;
+    if ((record.data & mask) != (out & mask))
+    {
+        // keep going, later operations usually still line up
+        ESP_LOGW(TAG, "trace replay: wrote 0x%02x, recorded 0x%02x", out & mask, record.data & mask);
+        ++trace->stats.divergences;
+    }
+    return record.status;
+}
+
+static owb_status _replay_read_bits(const OneWireBus *bus, uint8_t *in, int number_of_bits_to_read)
+{
+    DS18B20_Trace *trace = container_of(bus, DS18B20_Trace, bus);
+    TraceRecord record;
+    ++trace->stats.reads;
+    if (!_replay_next(trace, TRACE_READ, number_of_bits_to_read, &record))
+    {
+        *in = 0xff; // an idle bus reads as ones
+        return OWB_STATUS_HW_ERROR;
+    }
+    *in = record.data;
+    return record.status;
+}
+
+static const struct owb_driver replay_driver = {
+    .name = "owb_trace_replay",
+    .uninitialize = _replay_uninitialize,
+    .reset = _replay_reset,
+    .write_bits = _replay_write_bits,
+    .read_bits = _replay_read_bits,
+};
+
+// Public API
+
+OneWireBus *ds18b20_trace_record(DS18B20_Trace *trace, const OneWireBus *target, FILE *file)
+{
+    if (trace == NULL || target == NULL || file == NULL)
+    {
+        ESP_LOGE(TAG, "trace record: NULL argument");
+        return NULL;
+    }
+    memset(trace, 0, sizeof(*trace));
+    trace->bus = *target; // same timing and power settings as the recorded bus
+    trace->bus.driver = &record_driver;
+    trace->target = target;
+    trace->file = file;
+    trace->last_us = -1;
+    if (fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC), file) != sizeof(TRACE_MAGIC))
+    {
+        ESP_LOGE(TAG, "trace write failed");
+        return NULL;
+    }
+    trace->stats.bytes = sizeof(TRACE_MAGIC);
+    ESP_LOGI(TAG, "recording bus %p", target);
+    return &trace->bus;
+}
+
+OneWireBus *ds18b20_trace_replay(DS18B20_Trace *trace, FILE *file)
+{
+    uint8_t magic[sizeof(TRACE_MAGIC)] = {0};
+    if (trace == NULL || file == NULL)
+    {
+        ESP_LOGE(TAG, "trace replay: NULL argument");
+        return NULL;
+    }
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0)
+    {
+        ESP_LOGE(TAG, "trace replay: not a recording");
+        return NULL;
+    }
+    memset(trace, 0, sizeof(*trace));
+    trace->bus.driver = &replay_driver;
+    trace->bus.strong_pullup_gpio = GPIO_NUM_NC;
+    trace->file = file;
+    trace->last_us = -1;
+    return &trace->bus;
+}
+
+void ds18b20_trace_close(DS18B20_Trace *trace)
+{
+    if (trace != NULL && trace->file != NULL)
+    {
+        if (trace->target != NULL)
+        {
+            fflush(trace->file);
+        }
+        ESP_LOGI(TAG, "trace: %u resets, %u writes, %u reads, %u bytes over %lld us, %u divergences",
+                 trace->stats.resets, trace->stats.writes, trace->stats.reads, trace->stats.bytes,
+                 (long long)trace->stats.recorded_us, trace->stats.divergences);
+        trace->file = NULL;
+    }
+}
+
+#endif // CONFIG_TEMP_TRACE
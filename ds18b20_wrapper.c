@@ -31,12 +31,15 @@
  */
 
 #include <stdbool.h>
+#include <string.h>
+#include <sys/time.h>
 
 #include "ds18b20_wrapper.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_log.h"
 
 #include "owb.h"
@@ -53,38 +56,814 @@ DS18B20_Info *devices[MAX_DEVICES] = {0};         ///< list of devices
 owb_rmt_driver_info rmt_driver_info;              ///< the rmt driver info for communicating over the owb
 static const char *TAG = CONFIG_TEMP_WRAPPER_TAG; ///< tag for logging
 
+static int16_t sweep_reading_store[MAX_DEVICES] = {0};     ///< raw readings of the last sweep without a frame
+static DS18B20_ERROR sweep_error_store[MAX_DEVICES] = {0}; ///< read results of the last sweep without a frame
+static int16_t *sweep_readings = sweep_reading_store;      ///< raw readings of the last sweep
+static DS18B20_ERROR *sweep_errors = sweep_error_store;    ///< read results of the last sweep
+static DS18B20_Frame *sweep_frame = NULL;                  ///< caller's frame the current sweep reads into, if any
+static bool sweep_published[MAX_DEVICES] = {0};            ///< devices reported by the last sweep
+static uint32_t sweep_sequence = 0;                        ///< number of sweeps taken since boot
+
+static int16_t report_deadband = CONFIG_TEMP_REPORT_DEADBAND;      ///< minimum change to report, in 1/16 degrees C
+static int64_t report_heartbeat_us = CONFIG_TEMP_REPORT_HEARTBEAT * 1000LL; ///< longest silence per device
+static DS18B20_PublishCallback publish_callback = NULL; ///< consumer of reported readings
+static void *publish_callback_arg = NULL;               ///< user argument for publish_callback
+static int16_t reported_readings[MAX_DEVICES] = {0};    ///< last reading reported per device
+static int64_t reported_times_us[MAX_DEVICES] = {0};    ///< time of the last report per device
+static bool reported[MAX_DEVICES] = {0};                ///< true once a device has been reported
+
+#ifdef CONFIG_TEMP_EVENTS
+static DS18B20_Snapshot snapshots[CONFIG_TEMP_EVENT_SNAPSHOTS] = {0}; ///< sweeps referenced by posted events
+static bool device_lost[MAX_DEVICES] = {0};             ///< devices that stopped responding
+static int8_t threshold_side[MAX_DEVICES] = {0};        ///< -1 below, 0 inside or 1 above the threshold band
+static int16_t threshold_low = INT16_MIN;               ///< lower edge of the threshold band, in 1/16 degrees C
+static int16_t threshold_high = INT16_MAX;              ///< upper edge of the threshold band, in 1/16 degrees C
+#endif
+#ifdef CONFIG_TEMP_HISTORY
+static DS18B20_History history = {0};                   ///< persistent store of past sweeps
+#endif
+#ifdef CONFIG_TEMP_ROLLUP
+static DS18B20_Rollup *rollup = NULL;                   ///< min/max/mean rollups of past sweeps
+#ifdef CONFIG_TEMP_HISTORY
+static bool rollup_pending = false;                     ///< true until the rollups are rebuilt from the history
+#endif
+#endif
+#ifdef CONFIG_TEMP_DIAGNOSTICS
+static DS18B20_Diagnostics diagnostics = {0};           ///< error rates and quality of the bus and devices
+static uint8_t sweep_bus_faults = 0;                    ///< faults seen on the bus during the current sweep
+#endif
+#ifdef CONFIG_TEMP_PLANNER
+static DS18B20_PlanRequest plan_requests[MAX_DEVICES] = {0}; ///< devices and deadlines planned for
+static DS18B20_Plan plan = {0};                              ///< plan of the last sweep
+#endif
+#ifdef CONFIG_TEMP_TRACE_RECORD
+static DS18B20_Trace trace = {0};                       ///< recording of every bus operation
+static FILE *trace_file = NULL;                         ///< file the recording is written to
+#endif
+static OneWireBus *supplied_bus = NULL;                 ///< bus to use instead of the rmt driver, if set
+static OneWireBus *rmt_bus = NULL;                      ///< bus init created on the rmt driver, NULL while a supplied bus is used
+#ifdef CONFIG_TEMP_MANIFEST_CHECK
+static OneWireBus_ROMCode manifest[MAX_DEVICES] = {0};   ///< rom codes expected on the bus
+static int manifest_count = -1;                         ///< devices in the manifest, -1 until it is loaded
+static DS18B20_ManifestResult manifest_result = {0};    ///< result of checking the last search against the manifest
+#endif
+#ifdef CONFIG_TEMP_REGISTRY
+static const DS18B20_Registry *registry = NULL;         ///< logical order and names of known devices
+#endif
+
+// ram each device adds, by the feature that holds it
+#ifdef CONFIG_TEMP_EVENTS
+#define EVENTS_DEVICE_SIZE (CONFIG_TEMP_EVENT_SNAPSHOTS * (sizeof(snapshots[0].readings[0]) + sizeof(snapshots[0].errors[0])) + \
+                            sizeof(device_lost[0]) + sizeof(threshold_side[0]))
+#else
+#define EVENTS_DEVICE_SIZE 0
+#endif
+#ifdef CONFIG_TEMP_HISTORY
+#define HISTORY_DEVICE_SIZE (sizeof(history.codec.last_values[0]) + (DS18B20_HISTORY_READING_MAX_BITS + 7) / 8)
+#else
+#define HISTORY_DEVICE_SIZE 0
+#endif
+#ifdef CONFIG_TEMP_DIAGNOSTICS
+#define DIAGNOSTICS_DEVICE_SIZE (sizeof(diagnostics.devices[0]))
+#else
+#define DIAGNOSTICS_DEVICE_SIZE 0
+#endif
+#ifdef CONFIG_TEMP_PLANNER
+#define PLANNER_DEVICE_SIZE (sizeof(plan_requests[0]) + 3 * sizeof(plan.steps[0]) + sizeof(plan.ready_us[0]) + \
+                             sizeof(plan.finish_us[0]))
+#else
+#define PLANNER_DEVICE_SIZE 0
+#endif
+#ifdef CONFIG_TEMP_MANIFEST_CHECK
+#define MANIFEST_DEVICE_SIZE (sizeof(manifest[0]) + 2 * sizeof(manifest_result.missing[0]) + \
+                              sizeof(manifest_result.sorted[0]) + sizeof(manifest_result.found[0]))
+#else
+#define MANIFEST_DEVICE_SIZE 0
+#endif
+#ifdef CONFIG_TEMP_ROLLUP
+#define ROLLUP_DEVICE_SIZE (DS18B20_ROLLUP_DEVICE_SIZE)
+#else
+#define ROLLUP_DEVICE_SIZE 0
+#endif
+
+/// static ram each of the MAX_DEVICES slots takes, whether or not a device is found
+#define DEVICE_STATIC_SIZE (sizeof(devices[0]) + sizeof(sweep_reading_store[0]) + sizeof(sweep_error_store[0]) + \
+                            sizeof(sweep_published[0]) + sizeof(reported_readings[0]) + sizeof(reported_times_us[0]) + \
+                            sizeof(reported[0]) + MANIFEST_DEVICE_SIZE + EVENTS_DEVICE_SIZE + HISTORY_DEVICE_SIZE + \
+                            DIAGNOSTICS_DEVICE_SIZE + PLANNER_DEVICE_SIZE)
+/// heap each device found takes
+#define DEVICE_HEAP_SIZE (sizeof(DS18B20_Info) + ROLLUP_DEVICE_SIZE)
+
+// test/ram_budget.sh measures the static ram per device of the compiled wrapper and checks it against this sum
+_Static_assert(DEVICE_STATIC_SIZE + DEVICE_HEAP_SIZE <= CONFIG_TEMP_DEVICE_RAM_BUDGET,
+               "ram per device exceeds CONFIG_TEMP_DEVICE_RAM_BUDGET");
+
+#if defined(CONFIG_TEMP_HISTORY) || defined(CONFIG_TEMP_ROLLUP) || defined(CONFIG_TEMP_EVENTS)
+/**
+ * @brief get the wall clock time
+ * @return milliseconds since the epoch, or since boot if the clock has not been set
+ */
+static int64_t _now_ms(void)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+#endif
+
+#if defined(CONFIG_TEMP_HISTORY) || defined(CONFIG_TEMP_ROLLUP)
+/// wall clock times before 2020-01-01 count from boot, as the clock has not been set by SNTP or the user
+#define WALL_CLOCK_VALID_MS 1577836800000LL
+
+/**
+ * @brief check that a wall clock time is on the epoch time base, so it can be stored with earlier sweeps
+ * @param time_ms the time from _now_ms
+ * @return true if the clock has been set
+ */
+static bool _clock_set(int64_t time_ms)
+{
+    return time_ms >= WALL_CLOCK_VALID_MS;
+}
+#endif
+
+/**
+ * @brief decide whether a device's reading from the last sweep should be reported
+ * readings are compared in raw units against the last reported reading, so slow drift
+ * is still reported once it adds up to more than the deadband
+ *
+ * @param device the index of the device
+ * @param now_us the monotonic time of the sweep
+ * @return true if the reading moved past the deadband or the heartbeat is due
+ */
+static bool _should_report(int device, int64_t now_us)
+{
+    if (sweep_errors[device] != DS18B20_OK)
+    {
+        return false;
+    }
+    if (!reported[device] || report_deadband < 0)
+    {
+        return true;
+    }
+    int32_t change = (int32_t)sweep_readings[device] - reported_readings[device];
+    change = change < 0 ? -change : change;
+    return change > report_deadband || now_us - reported_times_us[device] >= report_heartbeat_us;
+}
+
+#ifdef CONFIG_TEMP_EVENTS
+/**
+ * @brief snapshot the last sweep and post its events
+ * one snapshot is filled per sweep and every event of the sweep points at it
+ *
+ * @param count the number of devices read in the sweep
+ * @param now_ms the wall clock time of the sweep
+ */
+static void _post_sweep_events(int count, int64_t now_ms)
+{
+    DS18B20_Snapshot *snapshot = &snapshots[sweep_sequence % CONFIG_TEMP_EVENT_SNAPSHOTS];
+    snapshot->sequence = sweep_sequence;
+    snapshot->time_ms = now_ms;
+    snapshot->count = count;
+    memcpy(snapshot->readings, sweep_readings, count * sizeof(sweep_readings[0]));
+    memcpy(snapshot->errors, sweep_errors, count * sizeof(sweep_errors[0]));
+
+    DS18B20_EventData data = {.snapshot = snapshot, .sequence = sweep_sequence, .device = -1};
+    for (int i = 0; i < count; ++i)
+    {
+        data.device = i;
+        // only a device that did not answer is lost, one that was reset answers with its power-on value
+        if (sweep_errors[i] == DS18B20_ERROR_DEVICE)
+        {
+            if (!device_lost[i])
+            {
+                device_lost[i] = true;
+                ds18b20_events_post(DS18B20_EVENT_DEVICE_LOST, &data);
+            }
+            continue;
+        }
+        if (device_lost[i] && (sweep_errors[i] == DS18B20_OK || sweep_errors[i] == DS18B20_ERROR_POWER_ON))
+        {
+            device_lost[i] = false;
+            ds18b20_events_post(DS18B20_EVENT_DEVICE_ADDED, &data);
+        }
+        if (sweep_errors[i] == DS18B20_ERROR_CRC)
+        {
+            ds18b20_events_post(DS18B20_EVENT_CRC_ERROR, &data);
+        }
+        else if (sweep_errors[i] == DS18B20_ERROR_POWER_ON)
+        {
+            ds18b20_events_post(DS18B20_EVENT_DEVICE_RESET, &data);
+        }
+        else if (sweep_errors[i] == DS18B20_OK)
+        {
+            int8_t side = sweep_readings[i] < threshold_low ? -1 : (sweep_readings[i] > threshold_high ? 1 : 0);
+            if (side != threshold_side[i])
+            {
+                threshold_side[i] = side;
+                ds18b20_events_post(DS18B20_EVENT_THRESHOLD_CROSSED, &data);
+            }
+        }
+    }
+    data.device = -1;
+    ds18b20_events_post(DS18B20_EVENT_SWEEP_DONE, &data);
+}
+#endif
+
+#if defined(CONFIG_TEMP_ROLLUP) && defined(CONFIG_TEMP_HISTORY)
+/**
+ * @brief history iteration callback that feeds each stored sweep into the rollups
+ * readings stored as failed are passed on as errors so they are not counted
+ * @return always true to visit every stored sweep
+ */
+static bool _rollup_from_history(int64_t time_ms, const int16_t *values, int count, void *arg)
+{
+    DS18B20_ERROR errors[MAX_DEVICES];
+    for (int i = 0; i < count && i < MAX_DEVICES; ++i)
+    {
+        errors[i] = values[i] == DS18B20_HISTORY_INVALID ? DS18B20_ERROR_DEVICE : DS18B20_OK;
+    }
+    ds18b20_rollup_add((DS18B20_Rollup *)arg, time_ms, values, errors, count);
+    return true;
+}
+#endif
+
+/**
+ * @brief pass a completed sweep on to the enabled consumers
+ * @param count the number of devices read in the sweep
+ */
+static void _publish_sweep(int count)
+{
+#if defined(CONFIG_TEMP_HISTORY) || defined(CONFIG_TEMP_ROLLUP) || defined(CONFIG_TEMP_EVENTS)
+    int64_t now_ms = _now_ms();
+#endif
+    int64_t now_us = esp_timer_get_time();
+
+    for (int i = 0; i < count; ++i)
+    {
+        sweep_published[i] = _should_report(i, now_us);
+        if (sweep_published[i])
+        {
+            reported[i] = true;
+            reported_readings[i] = sweep_readings[i];
+            reported_times_us[i] = now_us;
+            if (publish_callback != NULL)
+            {
+                publish_callback(i, sweep_readings[i], publish_callback_arg);
+            }
+        }
+    }
+
+#ifdef CONFIG_TEMP_ROLLUP
+    // buckets are numbered from the epoch, so sweeps timed from boot are dropped until the clock is set
+    if (rollup != NULL && _clock_set(now_ms))
+    {
+#ifdef CONFIG_TEMP_HISTORY
+        if (rollup_pending)
+        {
+            // rebuild from the stored sweeps, before this one is stored, so queries cover the time before boot
+            rollup_pending = false;
+            ds18b20_history_iterate(&history, _rollup_from_history, rollup);
+        }
+#endif
+        ds18b20_rollup_add(rollup, now_ms, sweep_readings, sweep_errors, count);
+    }
+#endif
+#ifdef CONFIG_TEMP_HISTORY
+    // sweeps timed from boot cannot be ordered against stored ones, so none are stored until the clock is set
+    if (history.init && _clock_set(now_ms))
+    {
+        ds18b20_history_append(&history, now_ms, sweep_readings, sweep_errors, count);
+    }
+#endif
+#ifdef CONFIG_TEMP_EVENTS
+    _post_sweep_events(count, now_ms);
+#endif
+    ++sweep_sequence;
+}
+
+/**
+ * @brief start conversions and wait for them under the timeout policy of the timing device
+ * @param timing the device whose power mode and resolution decide the wait
+ * @param by_address true to address only the devices in the power mode of timing, false to convert the whole bus
+ * @param count the number of devices to sweep
+ * @return true if the conversion timed out and readings should be reported as stale
+ */
+static bool _convert_and_wait(const DS18B20_Info *timing, bool by_address, int count)
+{
+    DS18B20_ERROR wait_err = DS18B20_ERROR_UNKNOWN;
+    int attempts = 0;
+    bool parasitic = timing->power_mode == DS18B20_POWER_PARASITIC;
+    do
+    {
+        if (by_address)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                if (devices[i] != NULL && (devices[i]->power_mode == DS18B20_POWER_PARASITIC) == parasitic)
+                {
+                    ds18b20_convert(devices[i]);
+                }
+            }
+        }
+        else
+        {
+            ds18b20_convert_all(owb);
+        }
+        wait_err = ds18b20_wait_for_conversion_status(timing, NULL);
+    } while (wait_err == DS18B20_ERROR_TIMEOUT && timing->timeout_policy == DS18B20_TIMEOUT_RETRY &&
+             attempts++ < timing->timeout_retries);
+#ifdef CONFIG_TEMP_DIAGNOSTICS
+    sweep_bus_faults |= attempts > 0 && wait_err != DS18B20_ERROR_TIMEOUT ? DS18B20_FAULT_RETRY : 0;
+    sweep_bus_faults |= wait_err == DS18B20_ERROR_TIMEOUT ? DS18B20_FAULT_TIMEOUT : 0;
+#endif
+    return wait_err == DS18B20_ERROR_TIMEOUT && timing->timeout_policy != DS18B20_TIMEOUT_IGNORE;
+}
+
+/**
+ * @brief read one device into the sweep
+ * every read checks the CRC. with diagnostics enabled a degrading device repeats failed reads,
+ * more often the poorer its quality
+ *
+ * @param device the index of the device
+ * @param stale true if the conversion timed out
+ */
+static void _read_device(int device, bool stale)
+{
+    if (devices[device] == NULL)
+    {
+        // a registered device that was not found keeps its index and always reads as failed
+        sweep_errors[device] = DS18B20_ERROR_DEVICE;
+        if (sweep_frame != NULL)
+        {
+            sweep_frame->times_us[device] = esp_timer_get_time();
+        }
+        return;
+    }
+#ifdef CONFIG_TEMP_DIAGNOSTICS
+    DS18B20_DiagnosticsWindow *window = &diagnostics.devices[device];
+    int retries = window->quality == DS18B20_QUALITY_GOOD ? 0 : window->quality == DS18B20_QUALITY_DEGRADED ? 1 : 2;
+    int attempts = 0;
+    sweep_errors[device] = ds18b20_read_temp_raw(devices[device], &sweep_readings[device]);
+    while ((sweep_errors[device] == DS18B20_ERROR_CRC || sweep_errors[device] == DS18B20_ERROR_OWB) &&
+           attempts < retries)
+    {
+        ++attempts;
+        sweep_errors[device] = ds18b20_read_temp_raw(devices[device], &sweep_readings[device]);
+    }
+#else
+    sweep_errors[device] = ds18b20_read_temp_raw(devices[device], &sweep_readings[device]);
+#endif
+    if (stale && sweep_errors[device] == DS18B20_OK)
+    {
+        sweep_errors[device] = DS18B20_ERROR_TIMEOUT;
+    }
+    if (sweep_frame != NULL)
+    {
+        sweep_frame->times_us[device] = esp_timer_get_time();
+        sweep_frame->valid[device / 32] |= (uint32_t)(sweep_errors[device] == DS18B20_OK) << (device % 32);
+    }
+#ifdef CONFIG_TEMP_DIAGNOSTICS
+    uint8_t faults = ds18b20_diagnostics_faults(sweep_errors[device], devices[device]->use_crc, attempts);
+    sweep_bus_faults |= faults & ~DS18B20_SAMPLE_CRC_CHECKED;
+    if (ds18b20_diagnostics_record(window, faults))
+    {
+        ESP_LOGW(TAG, "device %d signal quality now %d, score %d", device, window->quality,
+                 ds18b20_diagnostics_score(window));
+    }
+#endif
+}
+
+#ifdef CONFIG_TEMP_DIAGNOSTICS
+/**
+ * @brief the time between sweeps
+ * @return the sample period, lengthened while the bus is in poor condition
+ */
+static int _sample_period_ms(void)
+{
+    if (diagnostics.bus.quality == DS18B20_QUALITY_POOR)
+    {
+        return CONFIG_TEMP_SAMPLE_PERIOD * CONFIG_TEMP_DIAGNOSTICS_SLOWDOWN;
+    }
+    return CONFIG_TEMP_SAMPLE_PERIOD;
+}
+#else
+#define _sample_period_ms() (CONFIG_TEMP_SAMPLE_PERIOD)
+#endif
+
+#ifdef CONFIG_TEMP_PLANNER
+/**
+ * @brief check at a planned wait whether the conversions a convert step started have completed
+ * devices answer read slots with 0 while they convert, but only until the next transaction, so this is
+ * called for a wait that directly follows the convert step. the timeout policy of the slowest device
+ * then applies as in _convert_and_wait. parasitic devices cannot signal, so their conversions are timed
+ *
+ * @param convert the convert step
+ * @param start_us the time the steps of the plan are measured from
+ * @param slots the index in devices[] of each planned request
+ * @param read true for each request already read
+ * @param planned the number of planned requests
+ * @param[out] stale set true for each request whose conversion timed out and whose reading may be stale
+ * @return false if the wait ended before the conversions were due, so the signal is still unread
+ */
+static bool _check_planned_conversion(const DS18B20_PlanStep *convert, int64_t start_us, const int *slots,
+                                      const bool *read, int planned, bool *stale)
+{
+    const DS18B20_Info *timing = NULL;
+    int32_t due_us = 0;
+    for (int i = 0; i < planned; ++i)
+    {
+        if (read[i] || (convert->type == DS18B20_STEP_CONVERT && convert->request != i))
+        {
+            continue;
+        }
+        if (ds18b20_is_parasitic(devices[slots[i]]))
+        {
+            return true;
+        }
+        if (timing == NULL || ds18b20_conversion_time_us(devices[slots[i]]) > ds18b20_conversion_time_us(timing))
+        {
+            timing = devices[slots[i]];
+        }
+        due_us = plan.ready_us[i] > due_us ? plan.ready_us[i] : due_us;
+    }
+    if (timing == NULL)
+    {
+        return true;
+    }
+    if (esp_timer_get_time() - start_us < due_us)
+    {
+        return false;
+    }
+
+    uint8_t status = 0;
+    ds18b20_bus_lock(owb);
+    owb_read_bit(owb, &status);
+    ds18b20_bus_unlock(owb);
+    DS18B20_ERROR wait_err = status ? DS18B20_OK : DS18B20_ERROR_TIMEOUT;
+    int attempts = 0;
+    while (wait_err == DS18B20_ERROR_TIMEOUT && timing->timeout_policy == DS18B20_TIMEOUT_RETRY &&
+           attempts++ < timing->timeout_retries)
+    {
+        if (convert->type == DS18B20_STEP_CONVERT_ALL)
+        {
+            ds18b20_convert_all(owb);
+        }
+        else
+        {
+            ds18b20_convert(timing);
+        }
+        wait_err = ds18b20_wait_for_conversion_status(timing, NULL);
+    }
+#ifdef CONFIG_TEMP_DIAGNOSTICS
+    sweep_bus_faults |= attempts > 0 && wait_err != DS18B20_ERROR_TIMEOUT ? DS18B20_FAULT_RETRY : 0;
+    sweep_bus_faults |= wait_err == DS18B20_ERROR_TIMEOUT ? DS18B20_FAULT_TIMEOUT : 0;
+#endif
+    if (wait_err == DS18B20_ERROR_TIMEOUT && timing->timeout_policy != DS18B20_TIMEOUT_IGNORE)
+    {
+        for (int i = 0; i < planned; ++i)
+        {
+            stale[i] |= !read[i] && (convert->type == DS18B20_STEP_CONVERT_ALL || convert->request == i);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief plan the sweep from the device deadlines and take its steps
+ * only the devices that were found are planned, registered devices that were not found fail at once.
+ * a conversion whose completion can still be read from the bus when its wait ends is checked and
+ * handled under the timeout policy, other conversions are trusted to finish in their planned time
+ * @param count the number of devices to sweep
+ */
+static void _sweep_planned(int count)
+{
+    DS18B20_PlanRequest requests[MAX_DEVICES];
+    int slots[MAX_DEVICES]; // the index in devices[] of each planned request
+    int planned = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (devices[i] == NULL)
+        {
+            _read_device(i, false);
+            continue;
+        }
+        plan_requests[i].device = devices[i];
+        requests[planned] = plan_requests[i];
+        slots[planned++] = i;
+    }
+    if (planned == 0)
+    {
+        return;
+    }
+    if (ds18b20_plan_build(requests, planned, &plan) == DS18B20_ERROR_TIMEOUT)
+    {
+        ESP_LOGW(TAG, "sweep plan misses %d deadline%s", plan.missed, plan.missed == 1 ? "" : "s");
+    }
+
+    bool read[MAX_DEVICES] = {false};
+    bool stale[MAX_DEVICES] = {false};
+    const DS18B20_PlanStep *signalling = NULL; // the convert step whose devices can still signal completion
+    int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < plan.step_count; ++i)
+    {
+        const DS18B20_PlanStep *step = &plan.steps[i];
+        switch (step->type)
+        {
+        case DS18B20_STEP_CONVERT_ALL:
+            ds18b20_convert_all(owb);
+            signalling = step;
+            break;
+        case DS18B20_STEP_CONVERT:
+            ds18b20_convert(devices[slots[step->request]]);
+            signalling = step;
+            break;
+        case DS18B20_STEP_WAIT:
+            ds18b20_sleep_until(start_us + step->at_us);
+            if (signalling != NULL && _check_planned_conversion(signalling, start_us, slots, read, planned, stale))
+            {
+                signalling = NULL;
+            }
+            break;
+        case DS18B20_STEP_READ:
+            _read_device(slots[step->request], stale[step->request]);
+            read[step->request] = true;
+            signalling = NULL;
+            break;
+        }
+    }
+}
+#endif
+
+/**
+ * @brief convert and read all devices then publish the sweep
+ * with the planner enabled the sweep follows the plan built from the device deadlines. otherwise
+ * all devices use the same resolution, and on a bus with both power modes the
+ * externally powered devices are converted by address and read as soon as they signal completion,
+ * then the parasitic device is converted by address under strong pull-up and pays the fixed wait.
+ * the two waits follow each other, so this lowers the latency of the external readings but
+ * lengthens the sweep. a single conversion of the whole bus with one fixed wait is used instead
+ * when both worst-case waits do not fit in the sample period, or when there are several parasitic
+ * devices, as addressing one would cut the strong pull-up of another
+ *
+ * @param count the number of devices to sweep
+ */
+static void _sweep(int count)
+{
+#ifdef CONFIG_TEMP_DIAGNOSTICS
+    sweep_bus_faults = 0;
+#endif
+#ifdef CONFIG_TEMP_PLANNER
+    _sweep_planned(count);
+#else
+    int first_parasitic = -1;
+    int first_external = -1;
+    int parasitic_count = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (devices[i] == NULL)
+        {
+            continue;
+        }
+        if (devices[i]->power_mode == DS18B20_POWER_PARASITIC)
+        {
+            first_parasitic = first_parasitic < 0 ? i : first_parasitic;
+            ++parasitic_count;
+        }
+        else
+        {
+            first_external = first_external < 0 ? i : first_external;
+        }
+    }
+    bool split = first_parasitic >= 0 && first_external >= 0 && parasitic_count == 1 &&
+                 ds18b20_conversion_time_us(devices[first_external]) + ds18b20_conversion_time_us(devices[first_parasitic]) <=
+                     (int64_t)_sample_period_ms() * 1000;
+
+    // Read the results immediately after conversion otherwise it may fail
+    if (split)
+    {
+        bool stale = _convert_and_wait(devices[first_external], true, count);
+        for (int i = 0; i < count; ++i)
+        {
+            if (devices[i] == NULL || devices[i]->power_mode != DS18B20_POWER_PARASITIC)
+            {
+                _read_device(i, stale);
+            }
+        }
+        stale = _convert_and_wait(devices[first_parasitic], true, count);
+        for (int i = 0; i < count; ++i)
+        {
+            if (devices[i] != NULL && devices[i]->power_mode == DS18B20_POWER_PARASITIC)
+            {
+                _read_device(i, stale);
+            }
+        }
+    }
+    else
+    {
+        // time the wait on a device that was found, none may be among the devices swept. a
+        // parasitic device gets the strong pull-up and the fixed wait for the whole bus
+        int first = first_parasitic >= 0 ? first_parasitic : first_external;
+        bool stale = first >= 0 && _convert_and_wait(devices[first], false, count);
+        for (int i = 0; i < count; ++i)
+        {
+            _read_device(i, stale);
+        }
+    }
+#endif
+#ifdef CONFIG_TEMP_DIAGNOSTICS
+    if (ds18b20_diagnostics_record(&diagnostics.bus, sweep_bus_faults))
+    {
+        ESP_LOGW(TAG, "bus signal quality now %d, score %d", diagnostics.bus.quality,
+                 ds18b20_diagnostics_score(&diagnostics.bus));
+    }
+#endif
+    _publish_sweep(count);
+}
+
+#ifdef CONFIG_TEMP_REGISTRY
+/**
+ * @brief move found devices to their logical index so it holds across boots
+ * regardless of the order the search finds them in, or which registered devices are missing.
+ * a registered device that was not found leaves a NULL hole at its index, and unregistered
+ * devices follow the highest registered index in search order
+ *
+ * @param slots the devices in search order, placed in place
+ * @param count the number of devices
+ * @return the number of slots in use, including holes
+ */
+static int _place_by_registry(DS18B20_Info **slots, int count)
+{
+    DS18B20_Info *unplaced[MAX_DEVICES];
+    int unplaced_count = 0;
+    DS18B20_Info *found[MAX_DEVICES];
+    memcpy(found, slots, count * sizeof(found[0]));
+    memset(slots, 0, MAX_DEVICES * sizeof(slots[0]));
+
+    int slot_count = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        const DS18B20_RegistryEntry *entry = ds18b20_registry_lookup(registry, found[i]->rom_code);
+        if (entry != NULL && entry->index < MAX_DEVICES && slots[entry->index] == NULL)
+        {
+            slots[entry->index] = found[i];
+            slot_count = entry->index >= slot_count ? entry->index + 1 : slot_count;
+        }
+        else
+        {
+            unplaced[unplaced_count++] = found[i];
+        }
+    }
+    int slot = slot_count;
+    for (int i = 0; i < unplaced_count; ++i)
+    {
+        if (slot >= MAX_DEVICES)
+        {
+            // no room after the registered devices, so fill the holes
+            slot = 0;
+        }
+        while (slots[slot] != NULL)
+        {
+            ++slot;
+        }
+        slots[slot++] = unplaced[i];
+        slot_count = slot > slot_count ? slot : slot_count;
+    }
+    for (int i = 0; i < slot_count; ++i)
+    {
+        if (slots[i] == NULL)
+        {
+            ESP_LOGW(TAG, "registered device %d not found, its readings will fail", i);
+        }
+    }
+    return slot_count;
+}
+#endif
+
+/**
+ * @brief bring up a device as soon as the search finds it
+ * allocates it, enables crc checks, sets its resolution and reads its power mode
+ *
+ * @param rom_code the rom code of the device
+ * @return the device, or NULL if it cannot be allocated
+ */
+static DS18B20_Info *_add_device(OneWireBus_ROMCode rom_code)
+{
+    DS18B20_Info *ds18b20_info = ds18b20_malloc(); // heap allocation
+    if (ds18b20_info == NULL)
+    {
+        return NULL;
+    }
+    int i = num_devices;
+    ds18b20_init(ds18b20_info, owb, rom_code); // associate with bus and device
+    ds18b20_use_crc(ds18b20_info, true);       // enable CRC check on all reads
+    ds18b20_set_resolution(ds18b20_info, DS18B20_RESOLUTION);
+
+    // Check each device for parasitic power, so externally powered devices can still
+    // signal the end of their conversions on a bus that mixes both
+    DS18B20_POWER_MODE power_mode = DS18B20_POWER_UNKNOWN;
+    if (ds18b20_read_power_supply(ds18b20_info, &power_mode) == DS18B20_OK &&
+        power_mode == DS18B20_POWER_PARASITIC)
+    {
+        ESP_LOGI(TAG, "device %d is parasitic-powered", i);
+    }
+    return ds18b20_info;
+}
+
 /**
  * @brief init the sensor
  * intitialises the onewire bus and finds and intialises ds18b20 sensors along the pin
- * @return the number of devices it found on the bus as an int
+ * @return the number of devices it found on the bus as an int, with a registry also counting
+ *         the holes left for registered devices that were not found
  */
 int ds18b20_wrapped_init(void)
 {
     ESP_LOGI(TAG, "setting up temp sensor");
-    owb = owb_rmt_initialize(&rmt_driver_info, GPIO_DS18B20_0, RMT_CHANNEL_1, RMT_CHANNEL_0);
+    if (supplied_bus != NULL)
+    {
+        owb = supplied_bus; // eg a simulated bus on the host
+    }
+    else
+    {
+        rmt_bus = owb_rmt_initialize(&rmt_driver_info, GPIO_DS18B20_0, RMT_CHANNEL_1, RMT_CHANNEL_0);
+        owb = rmt_bus;
+    }
+#ifdef CONFIG_TEMP_TRACE_RECORD
+    // record every operation the driver issues, for replay on the host
+    trace_file = fopen(CONFIG_TEMP_TRACE_FILE, "wb");
+    if (trace_file != NULL && ds18b20_trace_record(&trace, owb, trace_file) != NULL)
+    {
+        owb = &trace.bus;
+    }
+    else
+    {
+        ESP_LOGE(TAG, "cannot record bus to %s", CONFIG_TEMP_TRACE_FILE);
+    }
+#endif
     owb_use_crc(owb, true); // enable CRC check for ROM code
 
-    // Find all connected devices
+#ifdef CONFIG_TEMP_MANIFEST_CHECK
+    // Check the search result against the expected devices as it goes
+    if (manifest_count < 0)
+    {
+        manifest_count = ds18b20_manifest_parse(CONFIG_TEMP_MANIFEST, manifest, MAX_DEVICES);
+    }
+    if (manifest_count > 0)
+    {
+        ds18b20_manifest_begin(manifest, manifest_count, &manifest_result);
+    }
+#endif
+
+    // Find all connected devices, bringing each one up as soon as it is found
+    // the search restarts from a reset at every step, so commands to the device in between are safe
     ESP_LOGD(TAG, "find devices:");
-    OneWireBus_ROMCode device_rom_codes[MAX_DEVICES] = {0};
-
     OneWireBus_SearchState search_state = {0};
     bool found = false;
+    bool parasitic_power = false;
     owb_search_first(owb, &search_state, &found);
     while (found)
     {
         char rom_code_s[17];
         owb_string_from_rom_code(search_state.rom_code, rom_code_s, sizeof(rom_code_s));
         ESP_LOGD(TAG, "  %d : %s", num_devices, rom_code_s);
-        device_rom_codes[num_devices] = search_state.rom_code;
-        ++num_devices;
+#ifdef CONFIG_TEMP_MANIFEST_CHECK
+        if (manifest_count > 0)
+        {
+            ds18b20_manifest_add(&manifest_result, search_state.rom_code);
+        }
+#endif
+        if (num_devices >= MAX_DEVICES)
+        {
+            ESP_LOGW(TAG, "more than %d devices on the bus, ignoring %s", MAX_DEVICES, rom_code_s);
+        }
+        else if ((devices[num_devices] = _add_device(search_state.rom_code)) != NULL)
+        {
+            parasitic_power |= devices[num_devices]->power_mode == DS18B20_POWER_PARASITIC;
+            ++num_devices;
+        }
+        else
+        {
+            ESP_LOGE(TAG, "cannot allocate device %s", rom_code_s);
+        }
         owb_search_next(owb, &search_state, &found);
     }
     ESP_LOGI(TAG, "found %d device%s", num_devices, num_devices == 1 ? "" : "s");
-
-    // In this example, if a single device is present, then the ROM code is probably
-    // not very interesting, so just print it out. If there are multiple devices,
-    // then it may be useful to check that a specific device is present.
+#ifdef CONFIG_TEMP_MANIFEST_CHECK
+    if (manifest_count > 0)
+    {
+        ds18b20_manifest_end(&manifest_result);
+    }
+#endif
+#ifdef CONFIG_TEMP_REGISTRY
+    num_devices = _place_by_registry(devices, num_devices);
+#endif
+#ifdef CONFIG_TEMP_CALIBRATION
+    // the store is read once for all devices rather than once per device found
+    int calibrated = 0;
+    if (ds18b20_calibration_load_all(devices, num_devices, &calibrated) == DS18B20_OK && calibrated > 0)
+    {
+        ESP_LOGI(TAG, "%d device%s calibrated", calibrated, calibrated == 1 ? "" : "s");
+    }
+#endif
 
     if (num_devices == 1)
     {
@@ -101,87 +880,170 @@ int ds18b20_wrapped_init(void)
         {
             ESP_LOGE(TAG, "an error occurred reading ROM code: %d", status);
         }
+        ESP_LOGI(TAG, "single device optimisations enabled");
+        devices[0]->solo = true; // the rom code is no longer used for addressing, only to identify the device
     }
-    else
-    {
-        // Search for a known ROM code (LSB first):
-        // For example: 0x1502162ca5b2ee28
-        OneWireBus_ROMCode known_device = {
-            .fields.family = {0x28},
-            .fields.serial_number = {0xee, 0xb2, 0xa5, 0x2c, 0x16, 0x02},
-            .fields.crc = {0x15},
-        };
-        char rom_code_s[OWB_ROM_CODE_STRING_LENGTH];
-        owb_string_from_rom_code(known_device, rom_code_s, sizeof(rom_code_s));
-        bool is_present = false;
 
-        owb_status search_status = owb_verify_rom(owb, known_device, &is_present);
-        if (search_status == OWB_STATUS_OK)
-        {
-            ESP_LOGD(TAG, "device %s is %s", rom_code_s, is_present ? "present" : "not present");
-        }
-        else
-        {
-            ESP_LOGE(TAG, "an error occurred searching for known device: %d", search_status);
-        }
-    }
+    // In parasitic-power mode, devices cannot indicate when conversions are complete,
+    // so waiting for a temperature conversion must be done by waiting a prescribed duration.
+    // Devices detected above use their own power mode, this enables the strong pull-up
+    owb_use_parasitic_power(owb, parasitic_power);
+
+#ifdef CONFIG_ENABLE_STRONG_PULLUP_GPIO
+    // An external pull-up circuit is used to supply extra current to OneWireBus devices
+    // during temperature conversions.
+    owb_use_strong_pullup_gpio(owb, CONFIG_STRONG_PULLUP_GPIO);
+#endif
 
-    // Create DS18B20 devices on the 1-Wire bus
+#ifdef CONFIG_TEMP_DIAGNOSTICS
+    ds18b20_diagnostics_init(&diagnostics, num_devices);
+#endif
 
+#ifdef CONFIG_TEMP_PLANNER
     for (int i = 0; i < num_devices; ++i)
     {
-        DS18B20_Info *ds18b20_info = ds18b20_malloc(); // heap allocation
-        devices[i] = ds18b20_info;
-
-        if (num_devices == 1)
-        {
-            ESP_LOGI(TAG, "single device optimisations enabled");
-            ds18b20_init_solo(ds18b20_info, owb); // only one device on bus
-        }
-        else
-        {
-            ds18b20_init(ds18b20_info, owb, device_rom_codes[i]); // associate with bus and device
-        }
-        ds18b20_use_crc(ds18b20_info, true); // enable CRC check on all reads
-        ds18b20_set_resolution(ds18b20_info, DS18B20_RESOLUTION);
+        plan_requests[i].deadline_us = CONFIG_TEMP_PLANNER_DEADLINE * 1000;
     }
+#endif
 
-    // Check for parasitic-powered devices
-    bool parasitic_power = false;
-    ds18b20_check_for_parasite_power(owb, &parasitic_power);
-    if (parasitic_power)
+#ifdef CONFIG_TEMP_HISTORY
+    if (ds18b20_history_open(&history) != DS18B20_OK)
     {
-        ESP_LOGI(TAG, "parasitic-powered devices detected");
+        ESP_LOGE(TAG, "history unavailable, sweeps will not be stored");
     }
+#endif
 
-    // In parasitic-power mode, devices cannot indicate when conversions are complete,
-    // so waiting for a temperature conversion must be done by waiting a prescribed duration
-    owb_use_parasitic_power(owb, parasitic_power);
+#ifdef CONFIG_TEMP_EVENTS
+    for (int i = 0; i < num_devices; ++i)
+    {
+        if (devices[i] == NULL)
+        {
+            continue;
+        }
+        DS18B20_EventData data = {.snapshot = NULL, .sequence = sweep_sequence, .device = i};
+        ds18b20_events_post(DS18B20_EVENT_DEVICE_ADDED, &data);
+    }
+#endif
 
-#ifdef CONFIG_ENABLE_STRONG_PULLUP_GPIO
-    // An external pull-up circuit is used to supply extra current to OneWireBus devices
-    // during temperature conversions.
-    owb_use_strong_pullup_gpio(owb, CONFIG_STRONG_PULLUP_GPIO);
+#ifdef CONFIG_TEMP_ROLLUP
+    rollup = ds18b20_rollup_malloc(num_devices);
+#ifdef CONFIG_TEMP_HISTORY
+    // the stored sweeps are timed from the epoch, so the rebuild waits for the first sweep after the clock is set
+    rollup_pending = rollup != NULL && history.init;
+#endif
 #endif
 
     ESP_LOGI(TAG, "finished sensor init");
     return num_devices;
 }
 /**
- * @brief deinit the sensor
- * cleans up and frees all of the devices and the onewire bus
+ * @brief restart the sensors without re-initialising the bus or searching it again
+ * keeps the rmt driver and the device table, reads each device's configuration to check it
+ * still answers and puts back its resolution if it was lost, eg after a brown-out. falls back
+ * to a full init if the wrapper has not been initialised
+ *
+ * @return DS18B20_OK if every device answered and has its resolution, DS18B20_ERROR_DEVICE
+ *         if any did not, otherwise error
  */
-void ds18b20_wrapped_deinit(void)
+DS18B20_ERROR ds18b20_wrapped_restart(void)
 {
-    ESP_LOGI(TAG, "temp deinit start");
+    if (owb == NULL)
+    {
+        return ds18b20_wrapped_init() > 0 ? DS18B20_OK : DS18B20_ERROR_DEVICE;
+    }
+    ESP_LOGI(TAG, "temp restart");
+
+    bool present = false;
+    owb_status status = owb_reset(owb, &present);
+    if (status != OWB_STATUS_OK)
+    {
+        ESP_LOGE(TAG, "bus reset failed: %d", status);
+        return DS18B20_ERROR_OWB;
+    }
+    if (!present)
+    {
+        ESP_LOGE(TAG, "no devices present on restart");
+        return DS18B20_ERROR_DEVICE;
+    }
 
+    int missing = 0;
+    for (int i = 0; i < num_devices; ++i)
+    {
+        // a device may have been power cycled, so its configuration is read afresh and only written
+        // back if it differs. the read addresses the device and checks the crc, so a device that
+        // fails it is not present, and the bus is not searched again
+        bool is_present = false;
+        if (devices[i] != NULL)
+        {
+            ds18b20_invalidate_cache(devices[i]);
+            is_present = ds18b20_set_resolution(devices[i], DS18B20_RESOLUTION);
+        }
+        if (!is_present)
+        {
+            ESP_LOGW(TAG, "device %d not present or not configured on restart", i);
+            ++missing;
+        }
+    }
+    ESP_LOGI(TAG, "restarted %d of %d devices", num_devices - missing, num_devices);
+    return missing == 0 ? DS18B20_OK : DS18B20_ERROR_DEVICE;
+}
+/**
+ * @brief shut the sensor down without delay
+ * cleans up and frees all of the devices and the onewire bus init created, so ds18b20_wrapped_init can run again
+ */
+void ds18b20_wrapped_shutdown(void)
+{
     // clean up dynamically allocated data
     for (int i = 0; i < num_devices; ++i)
     {
         ds18b20_free(&devices[i]);
     }
-    owb_uninitialize(owb);
+    num_devices = 0;
+    if (owb != NULL)
+    {
+        ds18b20_bus_lock_release(owb);
+        owb = NULL;
+    }
+#ifdef CONFIG_TEMP_TRACE_RECORD
+    if (trace_file != NULL)
+    {
+        ds18b20_trace_close(&trace);
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+#endif
+    if (rmt_bus != NULL)
+    {
+        // a supplied bus belongs to the caller, so only the bus init created is uninitialised
+        owb_uninitialize(rmt_bus);
+        rmt_bus = NULL;
+    }
+#ifdef CONFIG_TEMP_HISTORY
+    if (history.init)
+    {
+        ds18b20_history_close(&history);
+    }
+#endif
+#ifdef CONFIG_TEMP_ROLLUP
+    ds18b20_rollup_free(&rollup);
+#endif
 
+    // forget what was reported, the devices found by the next init may differ
+    memset(sweep_published, 0, sizeof(sweep_published));
+    memset(reported, 0, sizeof(reported));
+#ifdef CONFIG_TEMP_EVENTS
+    memset(device_lost, 0, sizeof(device_lost));
+    memset(threshold_side, 0, sizeof(threshold_side));
+#endif
+}
+/**
+ * @brief deinit the sensor
+ * shuts the sensor down, then waits for the log output to drain
+ */
+void ds18b20_wrapped_deinit(void)
+{
+    ESP_LOGI(TAG, "temp deinit start");
+    ds18b20_wrapped_shutdown();
     ESP_LOGI(TAG, "temp deinit end");
 
     fflush(stdout);
@@ -202,34 +1064,24 @@ void ds18b20_wrapped_read(void)
     {
         TickType_t last_wake_time = xTaskGetTickCount();
 
-        ds18b20_convert_all(owb);
-
-        // In this application all devices use the same resolution,
-        // so use the first device to determine the delay
-        ds18b20_wait_for_conversion(devices[0]);
-
-        // Read the results immediately after conversion otherwise it may fail
-        float readings[MAX_DEVICES] = {0};
-        DS18B20_ERROR errors[MAX_DEVICES] = {0};
-
-        for (int i = 0; i < num_devices; ++i)
-        {
-            errors[i] = ds18b20_read_temp(devices[i], &readings[i]);
-        }
+        _sweep(num_devices);
 
         // Print results in a separate loop, after all have been read
         ESP_LOGI(TAG, "temperature readings (degrees C): sample %d", ++sample_count);
         for (int i = 0; i < num_devices; ++i)
         {
-            if (errors[i] != DS18B20_OK)
+            if (sweep_errors[i] != DS18B20_OK)
             {
                 ++errors_count[i];
             }
 
-            ESP_LOGI(TAG, "  %d: %.1f    %d errors", i, readings[i], errors_count[i]);
+            if (sweep_published[i] || sweep_errors[i] != DS18B20_OK)
+            {
+                ESP_LOGI(TAG, "  %d: %.1f    %d errors", i, sweep_readings[i] / 16.0f, errors_count[i]);
+            }
         }
 
-        vTaskDelayUntil(&last_wake_time, CONFIG_TEMP_SAMPLE_PERIOD / portTICK_PERIOD_MS);
+        vTaskDelayUntil(&last_wake_time, _sample_period_ms() / portTICK_PERIOD_MS);
     }
     else
     {
@@ -239,7 +1091,8 @@ void ds18b20_wrapped_read(void)
 /**
  * @brief capture temps to results
  * this function runs conversion on all the owb devices, waits for conversion to 
- * finish and then reads the temperatures into the provided results array
+ * finish and then reads the temperatures into the provided results array.
+ * at most num_devices entries are written
  *  
  * @param[in] results a pointer to the array to capture results to
  * @param[out] results the array pointer that has been populated with data
@@ -248,18 +1101,354 @@ void ds18b20_wrapped_read(void)
 void ds18b20_wrapped_capture(float *results, int size)
 {
     TickType_t last_wake_time = xTaskGetTickCount();
-    if (size > 0)
+    if (size > 0 && num_devices > 0)
+    {
+        // never read past the devices that were found
+        int count = size < num_devices ? size : num_devices;
+        _sweep(count);
+        for (int i = 0; i < count; ++i)
+        {
+            results[i] = sweep_readings[i] / 16.0f;
+        }
+    }
+    else
+    {
+        ESP_LOGE(TAG, "no DS18B20 devices detected or invalid size provided");
+    }
+    vTaskDelayUntil(&last_wake_time, _sample_period_ms() / portTICK_PERIOD_MS);
+}
+/**
+ * @brief capture temps to results in integer units
+ * as ds18b20_wrapped_capture, but each reading is converted from the raw value with integer
+ * arithmetic only, so every consumer of the results sees the same rounding
+ *
+ * @param[out] results the array to capture results to, at most num_devices entries are written
+ * @param size the size of the results array
+ * @param unit the units of the results
+ */
+void ds18b20_wrapped_capture_units(int32_t *results, int size, DS18B20_UNIT unit)
+{
+    TickType_t last_wake_time = xTaskGetTickCount();
+    if (size > 0 && num_devices > 0)
     {
-        ds18b20_convert_all(owb);
-        ds18b20_wait_for_conversion(devices[0]);
-        for (int i = 0; i < size; ++i)
+        int count = size < num_devices ? size : num_devices;
+        _sweep(count);
+        for (int i = 0; i < count; ++i)
         {
-            ds18b20_read_temp(devices[i], &results[i]);
+            results[i] = ds18b20_convert_units(sweep_readings[i], unit);
         }
     }
     else
     {
         ESP_LOGE(TAG, "no DS18B20 devices detected or invalid size provided");
     }
-    vTaskDelayUntil(&last_wake_time, CONFIG_TEMP_SAMPLE_PERIOD / portTICK_PERIOD_MS);
-}
\ No newline at end of file
+    vTaskDelayUntil(&last_wake_time, _sample_period_ms() / portTICK_PERIOD_MS);
+}
+/**
+ * @brief capture a sweep straight into a caller-owned frame
+ * the sweep reads each device directly into the frame's arrays, so there is no intermediate
+ * copy, and readings that failed or timed out are left out of the validity mask
+ *
+ * @param[in,out] frame the frame to fill, its capacity and arrays are set by the caller
+ * @return DS18B20_OK if a sweep was captured, DS18B20_ERROR_PARAM if the frame is incomplete,
+ *         DS18B20_ERROR_DEVICE if there are no devices
+ */
+DS18B20_ERROR ds18b20_wrapped_capture_frame(DS18B20_Frame *frame)
+{
+    if (frame == NULL || frame->capacity <= 0 || frame->readings == NULL || frame->errors == NULL ||
+        frame->valid == NULL || frame->times_us == NULL)
+    {
+        ESP_LOGE(TAG, "frame needs a capacity and all of its arrays");
+        return DS18B20_ERROR_PARAM;
+    }
+    TickType_t last_wake_time = xTaskGetTickCount();
+    DS18B20_ERROR err = DS18B20_ERROR_DEVICE;
+    frame->count = 0;
+    if (num_devices > 0)
+    {
+        int count = frame->capacity < num_devices ? frame->capacity : num_devices;
+        memset(frame->valid, 0, DS18B20_FRAME_VALID_WORDS(count) * sizeof(*frame->valid));
+        frame->count = count;
+        frame->sequence = sweep_sequence;
+        sweep_readings = frame->readings;
+        sweep_errors = frame->errors;
+        sweep_frame = frame;
+        _sweep(count);
+        sweep_readings = sweep_reading_store;
+        sweep_errors = sweep_error_store;
+        sweep_frame = NULL;
+        err = DS18B20_OK;
+    }
+    else
+    {
+        ESP_LOGE(TAG, "no DS18B20 devices detected!");
+    }
+    vTaskDelayUntil(&last_wake_time, _sample_period_ms() / portTICK_PERIOD_MS);
+    return err;
+}
+/**
+ * @brief set the function that receives reported readings
+ * the callback runs in the sampling task once per reported device and sweep
+ *
+ * @param callback the function to call, or NULL to stop reporting
+ * @param arg user argument passed through to the callback
+ */
+void ds18b20_wrapped_set_publish_callback(DS18B20_PublishCallback callback, void *arg)
+{
+    publish_callback = callback;
+    publish_callback_arg = arg;
+}
+/**
+ * @brief configure change-only reporting
+ * a reading is reported when it differs from the last reported reading of the same device
+ * by more than the deadband, or when the device has been silent for the heartbeat period
+ *
+ * @param deadband minimum change in 1/16 degrees C, or -1 to report every reading
+ * @param heartbeat_ms longest time in milliseconds a device may go unreported
+ */
+void ds18b20_wrapped_set_deadband(int16_t deadband, int32_t heartbeat_ms)
+{
+    report_deadband = deadband;
+    report_heartbeat_us = heartbeat_ms * 1000LL;
+    for (int i = 0; i < MAX_DEVICES; ++i)
+    {
+        reported[i] = false;
+    }
+}
+
+/**
+ * @brief use an already initialised bus instead of the rmt driver on CONFIG_TEMP_OWB_GPIO
+ * must be called before ds18b20_wrapped_init, for example with the bus of a ds18b20_sim.
+ * the bus stays the caller's, ds18b20_wrapped_shutdown does not uninitialise it
+ *
+ * @param bus the bus to use, or NULL to go back to the rmt driver
+ */
+void ds18b20_wrapped_use_bus(OneWireBus *bus)
+{
+    supplied_bus = bus;
+}
+#ifdef CONFIG_TEMP_MANIFEST_CHECK
+/**
+ * @brief set the rom codes expected on the bus, replacing CONFIG_TEMP_MANIFEST
+ * must be called before ds18b20_wrapped_init, which checks the devices it finds against them
+ *
+ * @param rom_codes the expected rom codes, copied
+ * @param count the number of rom codes, or 0 to skip the check
+ * @return DS18B20_OK if the manifest was set, otherwise error
+ */
+DS18B20_ERROR ds18b20_wrapped_set_manifest(const OneWireBus_ROMCode *rom_codes, int count)
+{
+    if (count < 0 || count > MAX_DEVICES || (rom_codes == NULL && count > 0))
+    {
+        ESP_LOGE(TAG, "manifest must hold 0 to %d devices", MAX_DEVICES);
+        return DS18B20_ERROR_PARAM;
+    }
+    memcpy(manifest, rom_codes, count * sizeof(*manifest));
+    manifest_count = count;
+    return DS18B20_OK;
+}
+/**
+ * @brief get the result of checking the devices found at init against the manifest
+ * @return the missing and unexpected devices, all counts are zero if there is no manifest
+ */
+const DS18B20_ManifestResult *ds18b20_wrapped_manifest_result(void)
+{
+    return &manifest_result;
+}
+#endif
+
+#ifdef CONFIG_TEMP_DIAGNOSTICS
+/**
+ * @brief get the error rates and quality scores of the bus and devices
+ * ds18b20_diagnostics_log prints them
+ *
+ * @return pointer to the diagnostics, updated by every sweep
+ */
+const DS18B20_Diagnostics *ds18b20_wrapped_diagnostics(void)
+{
+    return &diagnostics;
+}
+#endif
+
+#ifdef CONFIG_TEMP_PLANNER
+/**
+ * @brief set the time from the start of a sweep by which a device must be read
+ * the planner orders conversions and reads so every device meets its deadline if it can
+ *
+ * @param device the index of the device
+ * @param deadline_ms the deadline in milliseconds
+ * @return DS18B20_OK if the deadline was set, otherwise error
+ */
+DS18B20_ERROR ds18b20_wrapped_set_deadline(int device, int32_t deadline_ms)
+{
+    if (device < 0 || device >= num_devices || deadline_ms <= 0 || deadline_ms > INT32_MAX / 1000)
+    {
+        ESP_LOGE(TAG, "invalid deadline %d ms for device %d", deadline_ms, device);
+        return DS18B20_ERROR_PARAM;
+    }
+    plan_requests[device].deadline_us = deadline_ms * 1000;
+    return DS18B20_OK;
+}
+/**
+ * @brief get the plan the last sweep followed
+ * its requests are the devices that were found, in index order. ds18b20_plan_log prints it
+ *
+ * @return pointer to the plan, updated by every sweep
+ */
+const DS18B20_Plan *ds18b20_wrapped_plan(void)
+{
+    return &plan;
+}
+#endif
+
+#ifdef CONFIG_TEMP_REGISTRY
+/**
+ * @brief set the registry used to order devices and look up their names
+ * each registered device is placed at its logical index, which stays empty if it is not found.
+ * must be called before ds18b20_wrapped_init, and the registry must outlive the wrapper
+ *
+ * @param device_registry the registry, or NULL to keep devices in search order
+ */
+void ds18b20_wrapped_set_registry(const DS18B20_Registry *device_registry)
+{
+    registry = device_registry;
+}
+/**
+ * @brief get the registry entry of a device
+ * @param device the index of the device in devices[]
+ * @return the entry holding the name and location of the device, or NULL if it is not registered
+ */
+const DS18B20_RegistryEntry *ds18b20_wrapped_entry(int device)
+{
+    if (device < 0 || device >= num_devices || devices[device] == NULL)
+    {
+        return NULL;
+    }
+    return ds18b20_registry_lookup(registry, devices[device]->rom_code);
+}
+#endif
+
+#ifdef CONFIG_TEMP_EVENTS
+/**
+ * @brief set the band outside of which readings raise DS18B20_EVENT_THRESHOLD_CROSSED
+ * the event is posted whenever a device moves between below, inside and above the band
+ *
+ * @param low the lowest reading inside the band, in 1/16 degrees C
+ * @param high the highest reading inside the band, in 1/16 degrees C
+ */
+void ds18b20_wrapped_set_thresholds(int16_t low, int16_t high)
+{
+    threshold_low = low;
+    threshold_high = high;
+}
+#endif
+
+#ifdef CONFIG_TEMP_HISTORY
+/**
+ * @brief get the history store the wrapper appends every sweep to
+ * @return pointer to the store, or NULL if it could not be opened
+ */
+DS18B20_History *ds18b20_wrapped_history(void)
+{
+    return history.init ? &history : NULL;
+}
+#endif
+
+/**
+ * @brief get the ram taken by the wrapper and the driver
+ * static sizes follow CONFIG_TEMP_MAX_DEVS and the enabled features, heap follows the devices
+ * found by init. the stack is that of the calling task, so call it from the task that sweeps
+ *
+ * @param memory the sizes, in bytes
+ * @param stack_size the stack size of the calling task in bytes, as it was created with
+ */
+void ds18b20_wrapped_memory(DS18B20_Memory *memory, size_t stack_size)
+{
+    size_t static_size = sizeof(owb) + sizeof(num_devices) + sizeof(devices) + sizeof(rmt_driver_info) +
+                         sizeof(sweep_reading_store) + sizeof(sweep_error_store) + sizeof(sweep_readings) +
+                         sizeof(sweep_errors) + sizeof(sweep_frame) + sizeof(sweep_published) + sizeof(sweep_sequence) +
+                         sizeof(report_deadband) + sizeof(report_heartbeat_us) + sizeof(publish_callback) +
+                         sizeof(publish_callback_arg) + sizeof(reported_readings) + sizeof(reported_times_us) +
+                         sizeof(reported) + sizeof(supplied_bus) + sizeof(rmt_bus);
+#ifdef CONFIG_TEMP_MANIFEST_CHECK
+    static_size += sizeof(manifest) + sizeof(manifest_count) + sizeof(manifest_result);
+#endif
+#ifdef CONFIG_TEMP_EVENTS
+    static_size += sizeof(snapshots) + sizeof(device_lost) + sizeof(threshold_side) + sizeof(threshold_low) +
+                   sizeof(threshold_high);
+#endif
+#ifdef CONFIG_TEMP_HISTORY
+    static_size += sizeof(history);
+#endif
+#ifdef CONFIG_TEMP_ROLLUP
+    static_size += sizeof(rollup);
+#endif
+#ifdef CONFIG_TEMP_DIAGNOSTICS
+    static_size += sizeof(diagnostics) + sizeof(sweep_bus_faults);
+#endif
+#ifdef CONFIG_TEMP_PLANNER
+    static_size += sizeof(plan_requests) + sizeof(plan);
+#endif
+#ifdef CONFIG_TEMP_TRACE_RECORD
+    static_size += sizeof(trace) + sizeof(trace_file);
+#endif
+#ifdef CONFIG_TEMP_REGISTRY
+    static_size += sizeof(registry);
+#endif
+
+    memory->static_size = static_size + ds18b20_static_size();
+    memory->static_device_size = DEVICE_STATIC_SIZE;
+    memory->heap_size = 0;
+    for (int i = 0; i < num_devices; ++i)
+    {
+        memory->heap_size += devices[i] != NULL ? sizeof(DS18B20_Info) : 0;
+    }
+#ifdef CONFIG_TEMP_ROLLUP
+    memory->heap_size += ds18b20_rollup_size(rollup);
+#endif
+    memory->heap_device_size = DEVICE_HEAP_SIZE;
+    size_t stack_free = uxTaskGetStackHighWaterMark(NULL) * sizeof(StackType_t);
+    memory->stack_used_size = stack_size > stack_free ? stack_size - stack_free : 0;
+
+    ESP_LOGI(TAG, "ram: static %u (%u per device of %d), heap %u (%u per device of %d), stack used %u of %u",
+             (unsigned)memory->static_size, (unsigned)memory->static_device_size, MAX_DEVICES,
+             (unsigned)memory->heap_size, (unsigned)memory->heap_device_size, num_devices,
+             (unsigned)memory->stack_used_size, (unsigned)stack_size);
+}
+
+#ifdef CONFIG_TEMP_ROLLUP
+/**
+ * @brief get the rollups the wrapper maintains from every sweep
+ * @return pointer to the rollups, or NULL if they could not be created
+ */
+DS18B20_Rollup *ds18b20_wrapped_rollup(void)
+{
+    return rollup;
+}
+/**
+ * @brief aggregate the recent readings of a device
+ * for example the maximum of device 17 over the last day is in stats.max after
+ * ds18b20_wrapped_query(17, 24 * 60 * 60 * 1000, &stats)
+ *
+ * @param device the index of the device
+ * @param duration_ms how far back from now to look
+ * @param[out] stats the min, max, mean and count of the readings
+ * @return DS18B20_OK if the query succeeded, otherwise error
+ */
+DS18B20_ERROR ds18b20_wrapped_query(int device, int64_t duration_ms, DS18B20_RollupStats *stats)
+{
+    if (rollup == NULL)
+    {
+        ESP_LOGE(TAG, "rollups not available");
+        return DS18B20_ERROR_UNKNOWN;
+    }
+    int64_t now_ms = _now_ms();
+    if (!_clock_set(now_ms))
+    {
+        ESP_LOGE(TAG, "wall clock not set, rollups are empty");
+        return DS18B20_ERROR_UNKNOWN;
+    }
+    int64_t from_ms = now_ms - duration_ms;
+    return ds18b20_rollup_query(rollup, device, from_ms > 0 ? from_ms : 0, now_ms + 1, stats);
+}
+#endif
\ No newline at end of file
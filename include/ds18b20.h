@@ -34,6 +34,8 @@
 #ifndef DS18B20_H
 #define DS18B20_H
 
+#include <stddef.h>
+
 #include "owb.h"
 
 #ifdef __cplusplus
@@ -52,6 +54,11 @@ extern "C"
         DS18B20_ERROR_CRC,          ///< A CRC error occurred
         DS18B20_ERROR_OWB,          ///< A One Wire Bus error occurred
         DS18B20_ERROR_NULL,         ///< A parameter or value is NULL
+        DS18B20_ERROR_PARAM,        ///< A parameter is out of range
+        DS18B20_ERROR_STORAGE,      ///< A persistent storage error occurred
+        DS18B20_ERROR_TIMEOUT,      ///< A conversion did not complete in time
+        DS18B20_ERROR_BUSY,         ///< A resource is still in use
+        DS18B20_ERROR_POWER_ON,     ///< The device answered with its power-on value, it was reset since it last converted
     } DS18B20_ERROR;
 
     /**
@@ -66,18 +73,88 @@ extern "C"
         DS18B20_RESOLUTION_12_BIT = 12,  ///< 12-bit resolution (default)
     } DS18B20_RESOLUTION;
 
+    /**
+ * @brief What to do when a device has not signalled the end of a conversion in time.
+ */
+    typedef enum
+    {
+        DS18B20_TIMEOUT_IGNORE, ///< Read anyway and report success, as if the conversion had completed
+        DS18B20_TIMEOUT_FAIL,   ///< Read anyway but report DS18B20_ERROR_TIMEOUT, as the value may be stale
+        DS18B20_TIMEOUT_RETRY,  ///< Convert again up to timeout_retries times, then behave as DS18B20_TIMEOUT_FAIL
+    } DS18B20_TIMEOUT_POLICY;
+
+    /**
+ * @brief How a device is powered, which decides how the end of a conversion is detected.
+ */
+    typedef enum
+    {
+        DS18B20_POWER_UNKNOWN = 0, ///< Not detected, the parasitic power setting of the bus applies
+        DS18B20_POWER_EXTERNAL,    ///< Powered through VDD, signals when a conversion is complete
+        DS18B20_POWER_PARASITIC,   ///< Powered through the data line, conversions need a fixed wait
+    } DS18B20_POWER_MODE;
+
+    /**
+ * @brief Units of integer temperature readings.
+ */
+    typedef enum
+    {
+        DS18B20_UNIT_SIXTEENTH_C, ///< 1/16 degrees Celsius, the raw register unit
+        DS18B20_UNIT_CENTI_C,     ///< 0.01 degrees Celsius
+        DS18B20_UNIT_MILLI_C,     ///< 0.001 degrees Celsius
+        DS18B20_UNIT_CENTI_F,     ///< 0.01 degrees Fahrenheit
+    } DS18B20_UNIT;
+
+#define DS18B20_CALIBRATION_GAIN_ONE (1 << 14) ///< Calibration gain of 1.0 in Q2.14
+
+    /**
+ * @brief Linear calibration applied to every reading: value * gain + offset.
+ */
+    typedef struct
+    {
+        int16_t offset; ///< Added after the gain, in 1/16 degrees Celsius
+        int16_t gain;   ///< Multiplier in Q2.14, DS18B20_CALIBRATION_GAIN_ONE for none
+    } DS18B20_Calibration;
+
+    /**
+ * @brief Configuration applied to a device in a single scratchpad write by ds18b20_apply_config.
+ */
+    typedef struct
+    {
+        DS18B20_RESOLUTION resolution; ///< Temperature measurement resolution
+        int8_t trigger_high;           ///< High alarm trigger (TH), in whole degrees Celsius
+        int8_t trigger_low;            ///< Low alarm trigger (TL), in whole degrees Celsius, at most trigger_high
+    } DS18B20_Config;
+
+    /**
+ * @brief Copy of the writable scratchpad registers, so configuration that is already in place needs no bus traffic.
+ */
+    typedef struct
+    {
+        bool valid;            ///< True if the registers below are known to match the device
+        uint8_t trigger_high;  ///< TH alarm trigger register
+        uint8_t trigger_low;   ///< TL alarm trigger register
+        uint8_t configuration; ///< Configuration register, holding the resolution
+    } DS18B20_ScratchpadCache;
+
     /**
  * @brief Structure containing information related to a single DS18B20 device connected
  * via a 1-Wire bus.
  */
     typedef struct
     {
-        bool init;                     ///< True if struct has been initialised, otherwise false
-        bool solo;                     ///< True if device is intended to be the only one connected to the bus, otherwise false
-        bool use_crc;                  ///< True if CRC checks are to be used when retrieving information from a device on the bus
-        const OneWireBus *bus;         ///< Pointer to 1-Wire bus information relevant to this device
-        OneWireBus_ROMCode rom_code;   ///< The ROM code used to address this device on the bus
-        DS18B20_RESOLUTION resolution; ///< Temperature measurement resolution per reading
+        bool init;                             ///< True if struct has been initialised, otherwise false
+        bool solo;                             ///< True if device is intended to be the only one connected to the bus, otherwise false
+        bool use_crc;                          ///< True if CRC checks are to be used when retrieving information from a device on the bus
+        const OneWireBus *bus;                 ///< Pointer to 1-Wire bus information relevant to this device
+        OneWireBus_ROMCode rom_code;           ///< The ROM code used to address this device on the bus
+        DS18B20_RESOLUTION resolution;         ///< Temperature measurement resolution per reading
+        uint16_t overtime_percent;             ///< Time allowed beyond the datasheet conversion time, in percent
+        DS18B20_TIMEOUT_POLICY timeout_policy; ///< Handling of conversions that exceed the allowed time
+        uint8_t timeout_retries;               ///< Additional conversions attempted under DS18B20_TIMEOUT_RETRY
+        DS18B20_POWER_MODE power_mode;         ///< Power supply of this device, as detected by ds18b20_read_power_supply
+        DS18B20_Calibration calibration;       ///< Correction applied to every reading of this device
+        bool verify;                           ///< True if scratchpad writes are read back to check them
+        DS18B20_ScratchpadCache cache;         ///< Last known writable scratchpad registers of this device
     } DS18B20_Info;
 
     /**
@@ -122,11 +199,31 @@ extern "C"
  */
     void ds18b20_use_crc(DS18B20_Info *ds18b20_info, bool use_crc);
 
+    /**
+ * @brief Enable or disable reading back the scratchpad after a configuration write.
+ * @param[in] ds18b20_info Pointer to device info instance.
+ * @param[in] verify True to check every write against the device (default), false to trust it.
+ */
+    void ds18b20_use_verify(DS18B20_Info *ds18b20_info, bool verify);
+
+    /**
+ * @brief Forget the cached scratchpad registers so the next configuration call reads them from the device.
+ *
+ * Call this when the device may have lost its configuration, for example after a brown-out, as the
+ * device then holds the values recalled from its EEPROM. Reads that fail their CRC check or return
+ * the power-on value already forget the cache, and only reads with CRC checks enabled fill it.
+ *
+ * @param[in] ds18b20_info Pointer to device info instance.
+ */
+    void ds18b20_invalidate_cache(DS18B20_Info *ds18b20_info);
+
     /**
  * @brief Set temperature measurement resolution.
  *
  * This programs the hardware to the specified resolution and sets the cached value to be the same.
  * If the program fails, the value currently in hardware is used to refresh the cache.
+ * If the cached scratchpad already holds the resolution, the bus is not used at all. If the
+ * configuration cannot be read, nothing is written so the alarm triggers are kept.
  *
  * @param[in] ds18b20_info Pointer to device info instance.
  * @param[in] resolution Selected resolution.
@@ -134,10 +231,28 @@ extern "C"
  */
     bool ds18b20_set_resolution(DS18B20_Info *ds18b20_info, DS18B20_RESOLUTION resolution);
 
+    /**
+ * @brief Apply resolution and alarm triggers together, as one transaction.
+ *
+ * The configuration is validated first and nothing is written unless it is valid. If the device
+ * already holds the configuration, according to the cached scratchpad or a single read, the bus is
+ * not written. Otherwise all three registers are written at once and, if verification is enabled,
+ * read back. On failure the device info keeps its previous resolution and the cache is dropped,
+ * as the device may hold either configuration.
+ *
+ * The configuration is held in the scratchpad only, it is not copied to the device EEPROM.
+ *
+ * @param[in] ds18b20_info Pointer to device info instance.
+ * @param[in] config The configuration to apply.
+ * @return DS18B20_OK if the device holds the configuration, otherwise an error code.
+ */
+    DS18B20_ERROR ds18b20_apply_config(DS18B20_Info *ds18b20_info, const DS18B20_Config *config);
+
     /**
  * @brief Update and return the current temperature measurement resolution from the device.
+ *        The cached scratchpad is used if it is valid, otherwise it is refreshed from the device.
  * @param[in] ds18b20_info Pointer to device info instance.
- * @return The currently configured temperature measurement resolution.
+ * @return The currently configured temperature measurement resolution, or DS18B20_RESOLUTION_INVALID if it cannot be read.
  */
     DS18B20_RESOLUTION ds18b20_read_resolution(DS18B20_Info *ds18b20_info);
 
@@ -172,6 +287,50 @@ extern "C"
  */
     float ds18b20_wait_for_conversion(const DS18B20_Info *ds18b20_info);
 
+    /**
+ * @brief Wait for a conversion to complete and report whether it did.
+ *
+ * In external power mode the wait ends when the device signals completion, or with
+ * DS18B20_ERROR_TIMEOUT once the datasheet conversion time plus overtime_percent has passed.
+ * In parasitic power mode the fixed datasheet duration is waited and the result is always DS18B20_OK.
+ * @param[in] ds18b20_info Pointer to device info instance.
+ * @param[out] elapsed_time Estimate of the time elapsed in milliseconds, may be NULL.
+ * @return DS18B20_OK if the conversion completed, DS18B20_ERROR_TIMEOUT if it did not, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_wait_for_conversion_status(const DS18B20_Info *ds18b20_info, float *elapsed_time);
+
+    /**
+ * @brief Get the longest time a conversion of a device may take.
+ * @param[in] ds18b20_info Pointer to device info instance.
+ * @return The datasheet conversion time at the device's resolution plus its overtime_percent, in
+ *         microseconds. A device of unknown resolution is assumed to convert at 12 bits.
+ */
+    int64_t ds18b20_conversion_time_us(const DS18B20_Info *ds18b20_info);
+
+    /**
+ * @brief Set how long to wait for conversions and what to do when they take longer.
+ *
+ * The defaults come from CONFIG_TEMP_CONVERSION_OVERTIME, CONFIG_TEMP_TIMEOUT_POLICY and
+ * CONFIG_TEMP_CONVERSION_RETRIES. The policy is applied by ds18b20_convert_and_read_temp().
+ * @param[in] ds18b20_info Pointer to device info instance.
+ * @param[in] overtime_percent Time allowed beyond the datasheet conversion time, in percent.
+ * @param[in] policy Handling of conversions that exceed the allowed time.
+ * @param[in] retries Additional conversions attempted under DS18B20_TIMEOUT_RETRY.
+ */
+    void ds18b20_set_timeout_policy(DS18B20_Info *ds18b20_info, uint16_t overtime_percent,
+                                    DS18B20_TIMEOUT_POLICY policy, uint8_t retries);
+
+    /**
+ * @brief Set the linear calibration of a device.
+ *
+ * The calibration is applied in integer arithmetic to the masked raw reading, so every
+ * successful reading returned by ds18b20_read_temp_raw() and ds18b20_read_temp() is already corrected.
+ * Failed reads return the uncorrected value, so the error placeholder and power-on value stay recognisable.
+ * @param[in] ds18b20_info Pointer to device info instance.
+ * @param[in] calibration Offset and gain, or NULL to remove the calibration.
+ */
+    void ds18b20_set_calibration(DS18B20_Info *ds18b20_info, const DS18B20_Calibration *calibration);
+
     /**
  * @brief Read last temperature measurement from device.
  *
@@ -183,11 +342,46 @@ extern "C"
  */
     DS18B20_ERROR ds18b20_read_temp(const DS18B20_Info *ds18b20_info, float *value);
 
+    /**
+ * @brief Read last temperature measurement from device without converting to floating point.
+ *
+ * The value is the two's complement register value with undefined bits for the current
+ * resolution masked off, in units of 1/16 degrees Celsius. A CRC failure or the power-on value
+ * forgets the cached scratchpad registers, as the device may have been reset.
+ * @param[in] ds18b20_info Pointer to device info instance. Must be initialised first.
+ * @param[out] value Pointer to the raw measurement value returned by the device, in 1/16 degrees Celsius.
+ * @return DS18B20_OK if read is successful, DS18B20_ERROR_POWER_ON if the device answered with its
+ *         power-on value, DS18B20_ERROR_DEVICE if it did not answer, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_read_temp_raw(const DS18B20_Info *ds18b20_info, int16_t *value);
+
+    /**
+ * @brief Convert a raw reading to other units with integer arithmetic only.
+ *
+ * Results are rounded to the nearest unit, halves upwards, so every consumer gets the same
+ * value for the same reading. 1/16 degrees Celsius is returned unchanged.
+ * @param[in] raw Reading in 1/16 degrees Celsius.
+ * @param[in] unit Units to convert to.
+ * @return The reading in the requested units.
+ */
+    int32_t ds18b20_convert_units(int16_t raw, DS18B20_UNIT unit);
+
+    /**
+ * @brief Read last temperature measurement from device in the requested units.
+ * @param[in] ds18b20_info Pointer to device info instance. Must be initialised first.
+ * @param[in] unit Units of the returned value.
+ * @param[out] value Pointer to the measurement value returned by the device.
+ * @return DS18B20_OK if read is successful, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_read_temp_units(const DS18B20_Info *ds18b20_info, DS18B20_UNIT unit, int32_t *value);
+
     /**
  * @brief Convert, wait and read current temperature from device.
+ *
+ * Conversions that time out are handled according to the device's timeout policy.
  * @param[in] ds18b20_info Pointer to device info instance. Must be initialised first.
  * @param[out] value Pointer to the measurement value returned by the device, in degrees Celsius.
- * @return DS18B20_OK if read is successful, otherwise error.
+ * @return DS18B20_OK if read is successful, DS18B20_ERROR_TIMEOUT if the value may be stale, otherwise error.
  */
     DS18B20_ERROR ds18b20_convert_and_read_temp(const DS18B20_Info *ds18b20_info, float *value);
 
@@ -200,6 +394,75 @@ extern "C"
  */
     DS18B20_ERROR ds18b20_check_for_parasite_power(const OneWireBus *bus, bool *present);
 
+    /**
+ * @brief Detect how a single device is powered and store the result in its info.
+ *        Unlike ds18b20_check_for_parasite_power, which tests the whole bus, this lets
+ *        externally powered devices on a mixed bus keep signalling the end of conversions.
+ *
+ * @param[in,out] ds18b20_info Pointer to device info instance.
+ * @param[out] power_mode Detected power supply, may be NULL.
+ * @return DS18B20_OK if the check is successful, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_read_power_supply(DS18B20_Info *ds18b20_info, DS18B20_POWER_MODE *power_mode);
+
+    /**
+ * @brief Decide whether a device's conversions must be timed and powered by the strong pull-up.
+ *        A device whose power mode has not been read follows the bus-wide parasitic power setting.
+ *
+ * @param[in] ds18b20_info Pointer to device info instance.
+ * @return True if the device is, or is assumed to be, parasitic-powered.
+ */
+    bool ds18b20_is_parasitic(const DS18B20_Info *ds18b20_info);
+
+    /**
+ * @brief Block the calling task until a time on the esp_timer clock.
+ *
+ * The task is woken by a one-shot esp_timer, so the wait is accurate to microseconds whatever
+ * CONFIG_FREERTOS_HZ is. Each of the first CONFIG_TEMP_WAIT_TASKS tasks to wait keeps one timer,
+ * created on its first wait. Other tasks, or a task whose timer cannot be created, have their
+ * waits rounded up to whole ticks.
+ *
+ * @param[in] time_us Time to wake at, as returned by esp_timer_get_time().
+ */
+    void ds18b20_sleep_until(int64_t time_us);
+
+    /**
+ * @brief Take exclusive use of a bus for a sequence of transactions.
+ *
+ * Each function in this component already locks the bus for the duration of its own transaction.
+ * This is only needed to keep several transactions, or direct owb_* calls, together.
+ * Locks are recursive and must be released with ds18b20_bus_unlock() by the same task.
+ * Does nothing unless CONFIG_TEMP_BUS_LOCK is enabled.
+ *
+ * @param[in] bus Pointer to initialised bus instance.
+ */
+    void ds18b20_bus_lock(const OneWireBus *bus);
+
+    /**
+ * @brief Release a bus locked with ds18b20_bus_lock().
+ * @param[in] bus Pointer to initialised bus instance.
+ */
+    void ds18b20_bus_unlock(const OneWireBus *bus);
+
+    /**
+ * @brief Free the lock of a bus that is no longer used, so another bus can take its slot.
+ *
+ * Locks are kept in CONFIG_TEMP_MAX_BUSES slots by bus, so call this before a bus is
+ * uninitialised or discarded. No task may use the bus once this has been called.
+ * Does nothing unless CONFIG_TEMP_BUS_LOCK is enabled.
+ *
+ * @param[in] bus Pointer to the bus.
+ * @return DS18B20_OK if the lock was released or the bus had none, DS18B20_ERROR_BUSY if a task
+ *         holds the lock, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_bus_lock_release(const OneWireBus *bus);
+
+    /**
+ * @brief Get the static RAM used by the component, shared by every device and bus.
+ * @return Size in bytes.
+ */
+    size_t ds18b20_static_size(void);
+
 #ifdef __cplusplus
 }
 #endif
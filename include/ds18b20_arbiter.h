@@ -0,0 +1,167 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_arbiter.h
+ * @brief Optional task that owns a 1-Wire bus and serves prioritised requests.
+ *
+ * Instead of driving the bus directly, tasks submit convert, read and configuration requests.
+ * The arbiter runs one bus transaction at a time and always picks the highest priority pending
+ * request next, so a control loop read waits for at most one transaction of a bulk sweep. The bus
+ * is free for higher priority reads while externally powered devices convert; such conversions are
+ * timed rather than polled, and a read of a device whose conversion it preempts reports
+ * DS18B20_ERROR_TIMEOUT with the previous value.
+ * Compatible requests are merged: a convert-all also completes every pending convert on the bus,
+ * and several reads or converts of the same device are served by a single bus transaction.
+ */
+
+#ifndef DS18B20_ARBITER_H
+#define DS18B20_ARBITER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+#include "ds18b20.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef CONFIG_TEMP_ARBITER_QUEUE_LENGTH
+#define DS18B20_ARBITER_QUEUE_LENGTH (CONFIG_TEMP_ARBITER_QUEUE_LENGTH) ///< maximum number of pending requests per arbiter
+#else
+#define DS18B20_ARBITER_QUEUE_LENGTH (16) ///< maximum number of pending requests per arbiter
+#endif
+
+    /**
+ * @brief Kinds of request served by the arbiter.
+ */
+    typedef enum
+    {
+        DS18B20_REQUEST_CONVERT,        ///< Convert on one device and wait for it to complete
+        DS18B20_REQUEST_CONVERT_ALL,    ///< Convert on all devices and wait, using the device's resolution for timing
+        DS18B20_REQUEST_READ,           ///< Read the last conversion result of one device
+        DS18B20_REQUEST_SET_RESOLUTION, ///< Program the resolution of one device
+    } DS18B20_REQUEST_TYPE;
+
+    /**
+ * @brief Suggested request priorities, higher values are served first.
+ */
+    typedef enum
+    {
+        DS18B20_PRIORITY_BULK = 0,    ///< Logging sweeps and other background work
+        DS18B20_PRIORITY_NORMAL = 1,  ///< Default priority
+        DS18B20_PRIORITY_CONTROL = 2, ///< Latency sensitive control loop reads
+    } DS18B20_PRIORITY;
+
+    struct DS18B20_Request;
+
+    /**
+ * @brief Called by the arbiter task when a request has completed.
+ * @param[in] request The completed request, owned by the caller again.
+ * @param[in] arg User argument from the request.
+ */
+    typedef void (*DS18B20_RequestCallback)(struct DS18B20_Request *request, void *arg);
+
+    /**
+ * @brief A request to the arbiter, owned by the caller and left untouched until it completes.
+ */
+    typedef struct DS18B20_Request
+    {
+        DS18B20_REQUEST_TYPE type;                                     ///< What to do
+        int priority;                                                  ///< Higher values are served first, equal values in submission order
+        DS18B20_Info *device;                                          ///< Device to act on, for CONVERT_ALL the device that sets the wait
+        DS18B20_RESOLUTION resolution;                                 ///< Resolution to program, SET_RESOLUTION only
+        DS18B20_RequestCallback callback;                              ///< Completion callback, run in the arbiter task, may be NULL
+        void *arg;                                                     ///< User argument for callback
+        DS18B20_ERROR result;                                          ///< Outcome, set before completion
+        int16_t value;                                                 ///< Raw reading in 1/16 degrees Celsius, READ only. Stale if result is DS18B20_ERROR_TIMEOUT
+        TaskHandle_t waiter;                                           ///< Private: task blocked in ds18b20_arbiter_execute()
+        uint32_t order;                                                ///< Private: submission order
+    } DS18B20_Request;
+
+    /**
+ * @brief Structure containing the state of a bus arbiter.
+ */
+    typedef struct
+    {
+        const OneWireBus *bus;                                         ///< The bus owned by the arbiter
+        TaskHandle_t task;                                             ///< The task serving requests
+        TaskHandle_t stopper;                                          ///< Task waiting in ds18b20_arbiter_free()
+        SemaphoreHandle_t mutex;                                       ///< Guards the pending requests
+        DS18B20_Request *pending[DS18B20_ARBITER_QUEUE_LENGTH];    ///< Requests waiting to be served
+        int count;                                                     ///< Number of pending requests
+        uint32_t next_order;                                           ///< Submission counter
+        bool stop;                                                     ///< True once the arbiter is shutting down
+        DS18B20_Request *converting[DS18B20_ARBITER_QUEUE_LENGTH]; ///< Conversion requests started and not yet due
+        int converting_count;                                          ///< Number of converting requests
+        int64_t converting_ready_us;                                   ///< esp_timer time the conversion is due
+        esp_timer_handle_t timer;                                      ///< Wakes the task when the conversion is due, may be NULL
+    } DS18B20_Arbiter;
+
+    /**
+ * @brief Construct an arbiter and start its task.
+ * @param[in] bus Pointer to initialised bus instance the arbiter will own.
+ * @param[in] task_priority FreeRTOS priority of the arbiter task.
+ * @return Pointer to the new arbiter, or NULL if it cannot be created.
+ */
+    DS18B20_Arbiter *ds18b20_arbiter_malloc(const OneWireBus *bus, UBaseType_t task_priority);
+
+    /**
+ * @brief Stop an arbiter and delete it. Pending requests complete with DS18B20_ERROR_UNKNOWN.
+ * @param[in,out] arbiter Pointer to arbiter instance that will be freed and set to NULL.
+ */
+    void ds18b20_arbiter_free(DS18B20_Arbiter **arbiter);
+
+    /**
+ * @brief Queue a request and return immediately.
+ * @param[in] arbiter Pointer to arbiter instance.
+ * @param[in] request Request to serve, which must stay valid until its callback has run.
+ * @return DS18B20_OK if the request was queued, DS18B20_ERROR_PARAM if its device is not on the
+ *         arbiter's bus, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_arbiter_submit(DS18B20_Arbiter *arbiter, DS18B20_Request *request);
+
+    /**
+ * @brief Queue a request and block until it completes.
+ *
+ * The calling task is woken with a task notification, so it must not be waiting on other
+ * notifications at the same time. The request callback is ignored.
+ * @param[in] arbiter Pointer to arbiter instance.
+ * @param[in] request Request to serve.
+ * @return The result of the request.
+ */
+    DS18B20_ERROR ds18b20_arbiter_execute(DS18B20_Arbiter *arbiter, DS18B20_Request *request);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DS18B20_ARBITER_H
@@ -0,0 +1,139 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_bench.h
+ * @brief Throughput and scaling benchmark of sweeps across device count, resolution, CRC policy,
+ *        power mode and bus count.
+ *
+ * A benchmark case searches its buses, configures every device found, then times repeated sweeps:
+ * a conversion of every bus at once, the waits the devices need, and a read of every device. The
+ * same run works on hardware buses and on simulated ones, where the bus time of the simulation is
+ * counted so the figures match what hardware would take. The matrix prints one markdown table row
+ * per case, which can be kept with a release and compared against the next.
+ */
+
+#ifndef DS18B20_BENCH_H
+#define DS18B20_BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "owb.h"
+#include "ds18b20.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef CONFIG_TEMP_BUS_LOCK
+#define DS18B20_BENCH_MAX_BUSES (CONFIG_TEMP_MAX_BUSES) ///< maximum number of buses swept together in a case, each needs a lock
+#else
+#define DS18B20_BENCH_MAX_BUSES (4) ///< maximum number of buses swept together in a case
+#endif
+
+    /**
+ * @brief Clock a benchmark is timed with.
+ * @param[in] arg Argument given with the clock.
+ * @return Current time in microseconds.
+ */
+    typedef int64_t (*DS18B20_BenchClock)(void *arg);
+
+    /**
+ * @brief One point of the benchmark matrix.
+ */
+    typedef struct
+    {
+        int device_count;              ///< Devices per bus
+        int bus_count;                 ///< Buses swept together
+        DS18B20_RESOLUTION resolution; ///< Resolution of every device
+        bool use_crc;                  ///< True to check the CRC of every read
+        bool parasitic;                ///< True for parasitic devices, only used when the devices are simulated
+    } DS18B20_BenchCase;
+
+    /**
+ * @brief Measurements of one case.
+ */
+    typedef struct
+    {
+        DS18B20_BenchCase bench_case; ///< The case measured
+        int device_count;             ///< Devices found over every bus
+        int sweeps;                   ///< Sweeps measured
+        int errors;                   ///< Reads that failed
+        float sweeps_per_second;      ///< Sweeps completed per second
+        int32_t sweep_us;             ///< Mean time of a sweep
+        int32_t latency_mean_us;      ///< Mean time from the start of a sweep to the end of a device's read
+        int32_t latency_max_us;       ///< Longest time from the start of a sweep to the end of a device's read
+    } DS18B20_BenchResult;
+
+    /**
+ * @brief Measure one case on the given buses.
+ * @param[in] buses The buses to sweep, bench_case->bus_count of them.
+ * @param[in] bench_case The case, up to device_count devices are used from each bus.
+ * @param[in] sweeps Number of sweeps to time.
+ * @param[in] clock Clock to time the sweeps with, or NULL for esp_timer.
+ * @param[in] clock_arg Argument given to the clock.
+ * @param[out] result The measurements.
+ * @return DS18B20_OK if every device was found and read, DS18B20_ERROR_DEVICE if some were missing,
+ *         DS18B20_ERROR_NULL or DS18B20_ERROR_PARAM for invalid arguments, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_bench_run(OneWireBus *const *buses, const DS18B20_BenchCase *bench_case, int sweeps,
+                                    DS18B20_BenchClock clock, void *clock_arg, DS18B20_BenchResult *result);
+
+    /**
+ * @brief Print the header of the results table.
+ */
+    void ds18b20_bench_print_header(void);
+
+    /**
+ * @brief Print the results of one case as a row of the table.
+ * @param[in] result The measurements.
+ */
+    void ds18b20_bench_print(const DS18B20_BenchResult *result);
+
+    /**
+ * @brief Measure one case on simulated buses, timed in bus time. Requires CONFIG_TEMP_SIM.
+ * @param[in] bench_case The case, device_count must not exceed DS18B20_SIM_MAX_DEVICES.
+ * @param[in] sweeps Number of sweeps to time.
+ * @param[out] result The measurements.
+ * @return DS18B20_OK on success, DS18B20_ERROR_NULL or DS18B20_ERROR_PARAM for invalid arguments,
+ *         otherwise error.
+ */
+    DS18B20_ERROR ds18b20_bench_sim(const DS18B20_BenchCase *bench_case, int sweeps, DS18B20_BenchResult *result);
+
+    /**
+ * @brief Measure and print every case of the matrix on simulated buses: 1 to DS18B20_SIM_MAX_DEVICES
+ *        devices in powers of 4, up to 256 as CONFIG_TEMP_SIM_MAX_DEVICES defaults to with the benchmark, 9 to 12-bit resolution, with and without CRC, external and parasitic
+ *        power, and 1, 2 and 4 buses up to DS18B20_BENCH_MAX_BUSES. Requires CONFIG_TEMP_SIM.
+ * @param[in] sweeps Number of sweeps to time in each case.
+ * @return Number of cases that failed.
+ */
+    int ds18b20_bench_matrix(int sweeps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DS18B20_BENCH_H
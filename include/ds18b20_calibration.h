@@ -0,0 +1,74 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_calibration.h
+ * @brief Persistent per-device calibration, keyed by ROM code and stored in NVS.
+ *
+ * All calibrations are kept in a single NVS blob of fixed-size entries, read into the heap
+ * rather than onto the caller's stack. ds18b20_calibration_load_all applies the calibration
+ * of every device found at start-up from one read of the blob. The NVS partition must have
+ * been initialised with nvs_flash_init() beforehand.
+ */
+
+#ifndef DS18B20_CALIBRATION_H
+#define DS18B20_CALIBRATION_H
+
+#include "ds18b20.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+ * @brief Apply the stored calibration of a device.
+ * @param[in,out] ds18b20_info Pointer to an initialised device info instance.
+ * @return DS18B20_OK if a calibration was applied, DS18B20_ERROR_DEVICE if none is stored for
+ *         the device, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_calibration_load(DS18B20_Info *ds18b20_info);
+
+    /**
+ * @brief Apply the stored calibrations of several devices, reading the store once.
+ * @param[in,out] devices Initialised device info instances, NULL entries are skipped.
+ * @param[in] count Number of entries in devices.
+ * @param[out] applied Number of devices a calibration was applied to.
+ * @return DS18B20_OK if the store was read or nothing has been stored, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_calibration_load_all(DS18B20_Info *const *devices, int count, int *applied);
+
+    /**
+ * @brief Store the current calibration of a device, replacing any stored before.
+ *        Storing an identity calibration removes the device from the store.
+ * @param[in] ds18b20_info Pointer to an initialised device info instance.
+ * @return DS18B20_OK if the calibration was stored, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_calibration_save(const DS18B20_Info *ds18b20_info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DS18B20_CALIBRATION_H
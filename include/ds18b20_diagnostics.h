@@ -0,0 +1,143 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_diagnostics.h
+ * @brief Sliding-window bus and device error rates, combined into a quality score.
+ *
+ * Every read of a device and every sweep of a bus is recorded as one sample holding the faults
+ * seen: missing presence pulse, CRC failure, conversion timeout and retries. Counts over the last
+ * CONFIG_TEMP_DIAGNOSTICS_WINDOW samples are kept up to date as samples enter and leave the
+ * window, and are weighted into a score from 0 (unusable) to 100 (no faults).
+ */
+
+#ifndef DS18B20_DIAGNOSTICS_H
+#define DS18B20_DIAGNOSTICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ds18b20.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef CONFIG_TEMP_DIAGNOSTICS_WINDOW
+#define DS18B20_DIAGNOSTICS_WINDOW (CONFIG_TEMP_DIAGNOSTICS_WINDOW) ///< number of samples in each sliding window
+#else
+#define DS18B20_DIAGNOSTICS_WINDOW (64) ///< number of samples in each sliding window
+#endif
+#define DS18B20_DIAGNOSTICS_MAX_DEVICES (CONFIG_TEMP_MAX_DEVS)     ///< number of devices tracked
+
+#define DS18B20_FAULT_PRESENCE 0x01u     ///< No presence pulse, or the device did not answer
+#define DS18B20_FAULT_CRC 0x02u          ///< Scratchpad CRC check failed
+#define DS18B20_FAULT_TIMEOUT 0x04u      ///< Conversion did not complete in time
+#define DS18B20_FAULT_RETRY 0x08u        ///< Operation succeeded only after a retry
+#define DS18B20_SAMPLE_CRC_CHECKED 0x80u ///< Sample flag: the CRC was checked, so a CRC failure could be seen
+
+    /**
+ * @brief Signal quality derived from the score.
+ */
+    typedef enum
+    {
+        DS18B20_QUALITY_GOOD,     ///< Score at or above CONFIG_TEMP_DIAGNOSTICS_DEGRADED_SCORE
+        DS18B20_QUALITY_DEGRADED, ///< Score at or above CONFIG_TEMP_DIAGNOSTICS_POOR_SCORE
+        DS18B20_QUALITY_POOR,     ///< Score below CONFIG_TEMP_DIAGNOSTICS_POOR_SCORE
+    } DS18B20_QUALITY;
+
+    /**
+ * @brief Fault counts over a sliding window of samples.
+ */
+    typedef struct
+    {
+        uint8_t samples[DS18B20_DIAGNOSTICS_WINDOW]; ///< Ring of fault masks, oldest at next once full
+        uint16_t next;                               ///< Position of the next sample in the ring
+        uint16_t count;                              ///< Number of samples in the window
+        uint16_t presence;                           ///< Samples in the window with DS18B20_FAULT_PRESENCE
+        uint16_t crc;                                ///< Samples in the window with DS18B20_FAULT_CRC
+        uint16_t timeout;                            ///< Samples in the window with DS18B20_FAULT_TIMEOUT
+        uint16_t retry;                              ///< Samples in the window with DS18B20_FAULT_RETRY
+        uint16_t crc_checked;                        ///< Samples in the window with DS18B20_SAMPLE_CRC_CHECKED
+        uint32_t total;                              ///< Samples recorded since init
+        uint32_t total_faulty;                       ///< Samples with any fault since init
+        DS18B20_QUALITY quality;                     ///< Quality after the last sample
+    } DS18B20_DiagnosticsWindow;
+
+    /**
+ * @brief Diagnostics for one bus and the devices on it.
+ */
+    typedef struct
+    {
+        DS18B20_DiagnosticsWindow bus;                                      ///< One sample per sweep of the bus
+        DS18B20_DiagnosticsWindow devices[DS18B20_DIAGNOSTICS_MAX_DEVICES]; ///< One sample per read of each device
+        int device_count;                                                   ///< Number of devices in use
+    } DS18B20_Diagnostics;
+
+    /**
+ * @brief Reset diagnostics so that every window is empty and of good quality.
+ * @param[out] diagnostics Pointer to diagnostics.
+ * @param[in] device_count Number of devices on the bus.
+ */
+    void ds18b20_diagnostics_init(DS18B20_Diagnostics *diagnostics, int device_count);
+
+    /**
+ * @brief Work out the fault mask of a single read.
+ * @param[in] err Result of the read.
+ * @param[in] crc_checked True if the read checked the CRC.
+ * @param[in] retries Number of times the read was repeated. A retry is only a fault of its own
+ *                    when the last attempt succeeded, otherwise the failure is counted instead.
+ * @return Fault mask for ds18b20_diagnostics_record.
+ */
+    uint8_t ds18b20_diagnostics_faults(DS18B20_ERROR err, bool crc_checked, int retries);
+
+    /**
+ * @brief Add a sample to a window, dropping the oldest sample once the window is full.
+ * @param[in,out] window Pointer to window.
+ * @param[in] faults Fault mask of the sample.
+ * @return True if the quality of the window changed.
+ */
+    bool ds18b20_diagnostics_record(DS18B20_DiagnosticsWindow *window, uint8_t faults);
+
+    /**
+ * @brief Score a window from its fault rates.
+ *        Presence and CRC failures cost two points per percent, timeouts one point and retries
+ *        half a point. The CRC rate is taken over the samples whose CRC was checked.
+ * @param[in] window Pointer to window.
+ * @return Score from 0 to 100, 100 if the window is empty.
+ */
+    int ds18b20_diagnostics_score(const DS18B20_DiagnosticsWindow *window);
+
+    /**
+ * @brief Log the scores and fault counts of a bus and its devices.
+ * @param[in] diagnostics Pointer to diagnostics.
+ */
+    void ds18b20_diagnostics_log(const DS18B20_Diagnostics *diagnostics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DS18B20_DIAGNOSTICS_H
@@ -0,0 +1,128 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_events.h
+ * @brief Typed event notifications for sweeps and device faults.
+ *
+ * Events are posted to the default esp_event loop under the DS18B20_EVENT base, which the
+ * application must create with esp_event_loop_create_default(). On host builds, where no event
+ * loop is available, handlers are kept in a small local table and called synchronously.
+ *
+ * Event data is a DS18B20_EventData that points at a shared snapshot of the sweep rather than
+ * carrying the readings itself. Snapshots are reused round robin, so a handler that runs later
+ * than CONFIG_TEMP_EVENT_SNAPSHOTS sweeps after the post must compare sequence numbers.
+ */
+
+#ifndef DS18B20_EVENTS_H
+#define DS18B20_EVENTS_H
+
+#include <stdint.h>
+
+#include "ds18b20.h"
+
+#ifdef CONFIG_IDF_TARGET_LINUX
+typedef const char *esp_event_base_t; ///< stand-in for the esp_event base type on host builds
+typedef void (*esp_event_handler_t)(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id,
+                                    void *event_data); ///< stand-in for the esp_event handler type on host builds
+#define ESP_EVENT_DECLARE_BASE(id) extern esp_event_base_t const id
+#define ESP_EVENT_DEFINE_BASE(id) esp_event_base_t const id = #id
+#define ESP_EVENT_ANY_ID -1
+#else
+#include "esp_event.h"
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    ESP_EVENT_DECLARE_BASE(DS18B20_EVENT);
+
+    /**
+ * @brief Event identifiers posted under DS18B20_EVENT.
+ */
+    typedef enum
+    {
+        DS18B20_EVENT_SWEEP_DONE,        ///< A sweep of all devices completed
+        DS18B20_EVENT_DEVICE_LOST,       ///< A device stopped answering the bus
+        DS18B20_EVENT_DEVICE_ADDED,      ///< A device was found at init, or recovered by answering again after being lost.
+                                         ///< Devices attached later are not searched for until the next init
+        DS18B20_EVENT_CRC_ERROR,         ///< A reading failed its CRC check
+        DS18B20_EVENT_THRESHOLD_CROSSED, ///< A reading moved into or out of the configured threshold band
+        DS18B20_EVENT_DEVICE_RESET,      ///< A device answered with its power-on value, eg after a brown-out
+    } DS18B20_EVENT_ID;
+
+    /**
+ * @brief Readings of one sweep, shared by all events posted for that sweep.
+ */
+    typedef struct
+    {
+        uint32_t sequence;                           ///< Sweep number, incremented for every sweep
+        int64_t time_ms;                             ///< Wall clock time of the sweep in milliseconds
+        int count;                                   ///< Number of devices read
+        int16_t readings[CONFIG_TEMP_MAX_DEVS];      ///< Raw readings, in 1/16 degrees Celsius
+        DS18B20_ERROR errors[CONFIG_TEMP_MAX_DEVS];  ///< Read result of each device
+    } DS18B20_Snapshot;
+
+    /**
+ * @brief Data posted with every DS18B20_EVENT.
+ */
+    typedef struct
+    {
+        const DS18B20_Snapshot *snapshot; ///< Sweep the event belongs to, NULL for events raised outside a sweep
+        uint32_t sequence;                ///< Sweep number at post time, the snapshot is stale if it no longer matches
+        int device;                       ///< Index of the device concerned, -1 for sweep events
+    } DS18B20_EventData;
+
+    /**
+ * @brief Register a handler for DS18B20 events.
+ * @param[in] event_id Event to handle, or ESP_EVENT_ANY_ID for all.
+ * @param[in] handler Function called with a DS18B20_EventData as event data.
+ * @param[in] arg User argument passed through to the handler.
+ * @return DS18B20_OK if the handler was registered, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_events_register(int32_t event_id, esp_event_handler_t handler, void *arg);
+
+    /**
+ * @brief Remove a handler registered with ds18b20_events_register().
+ * @param[in] event_id Event the handler was registered for.
+ * @param[in] handler Function to remove.
+ * @return DS18B20_OK if the handler was removed, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_events_unregister(int32_t event_id, esp_event_handler_t handler);
+
+    /**
+ * @brief Post a DS18B20 event without blocking.
+ * @param[in] event_id Event to post.
+ * @param[in] data Event data, copied by the event loop.
+ * @return DS18B20_OK if the event was queued or dispatched, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_events_post(DS18B20_EVENT_ID event_id, const DS18B20_EventData *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DS18B20_EVENTS_H
@@ -0,0 +1,124 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_group.h
+ * @brief Named conversion groups of devices that share a bus but convert on their own schedule.
+ *
+ * Each group is converted with addressed conversions and waited on according to the slowest
+ * resolution in it, so groups of different resolutions can overlap. For example a 9-bit group can
+ * be converted and read several times while a 12-bit group converts:
+ *
+ *     ds18b20_group_convert(&slow);
+ *     while (ds18b20_group_remaining_us(&slow) > ds18b20_group_remaining_us(&fast))
+ *     {
+ *         ds18b20_group_convert(&fast);
+ *         ds18b20_group_read(&fast, fast_values, NULL);
+ *     }
+ *     ds18b20_group_read(&slow, slow_values, NULL);
+ *
+ * The end of a conversion is timed, not polled, because a device only signals completion to read
+ * slots that immediately follow its convert command. A parasitic device must be alone in its
+ * group, and the strong pull-up it needs holds the bus until it has been read.
+ */
+
+#ifndef DS18B20_GROUP_H
+#define DS18B20_GROUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "owb.h"
+#include "ds18b20.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define DS18B20_GROUP_NAME_LENGTH 16 ///< storage for a group name, including the terminator
+
+    /**
+ * @brief A set of devices on one bus that are converted and read together.
+ */
+    typedef struct
+    {
+        char name[DS18B20_GROUP_NAME_LENGTH]; ///< Name of the group, for logging
+        const OneWireBus *bus;                ///< Bus all devices of the group are on
+        DS18B20_Info **devices;               ///< Devices of the group, owned by the caller
+        int count;                            ///< Number of devices
+        int64_t conversion_us;                ///< Longest conversion time of the devices, including overtime
+        int64_t ready_us;                     ///< esp_timer time the current conversion completes, 0 if none is running
+    } DS18B20_Group;
+
+    /**
+ * @brief Define a group.
+ * @param[out] group The group.
+ * @param[in] name Name of the group, truncated to fit.
+ * @param[in] devices Initialised devices on one bus, the array must outlive the group.
+ * @param[in] count Number of devices.
+ * @return DS18B20_OK if the group was defined, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_group_init(DS18B20_Group *group, const char *name, DS18B20_Info **devices, int count);
+
+    /**
+ * @brief Recalculate the wait of a group after the resolution or overtime of its devices changed.
+ * @param[in,out] group The group.
+ */
+    void ds18b20_group_update(DS18B20_Group *group);
+
+    /**
+ * @brief Start a conversion on every device of a group, by address.
+ * @param[in,out] group The group.
+ * @return DS18B20_OK if every device started converting, DS18B20_ERROR_DEVICE if any did not respond.
+ */
+    DS18B20_ERROR ds18b20_group_convert(DS18B20_Group *group);
+
+    /**
+ * @brief Get the time left until the current conversion of a group completes.
+ * @param[in] group The group.
+ * @return Microseconds until the conversion completes, 0 if it has or none is running.
+ */
+    int64_t ds18b20_group_remaining_us(const DS18B20_Group *group);
+
+    /**
+ * @brief Wait for the current conversion of a group to complete.
+ * @param[in] group The group.
+ */
+    void ds18b20_group_wait(const DS18B20_Group *group);
+
+    /**
+ * @brief Wait for the current conversion of a group to complete, then read every device.
+ * @param[in,out] group The group, its conversion is finished by the read.
+ * @param[out] values Raw readings in 1/16 degrees C, one per device.
+ * @param[out] errors Read result of each device, may be NULL.
+ * @return DS18B20_OK if every device was read, otherwise the first error.
+ */
+    DS18B20_ERROR ds18b20_group_read(DS18B20_Group *group, int16_t *values, DS18B20_ERROR *errors);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DS18B20_GROUP_H
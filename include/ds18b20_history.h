@@ -0,0 +1,154 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_history.h
+ * @brief Compressed, fixed-footprint history store for temperature sweeps.
+ *
+ * Sweeps of raw readings (1/16 degrees Celsius) are appended to a flash partition,
+ * or to a file on host builds. The storage is split into equally sized segments that
+ * are written append-only and reused round robin, so every sector is erased equally
+ * often and the oldest segment is discarded once the store is full.
+ *
+ * Within a segment, timestamps are stored as delta-of-delta values and readings as
+ * deltas from the previous reading of the same device, both bit-packed into
+ * variable length codes. A device that sits at a constant temperature costs one
+ * bit per sweep.
+ */
+
+#ifndef DS18B20_HISTORY_H
+#define DS18B20_HISTORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ds18b20.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define DS18B20_HISTORY_MAX_DEVICES (CONFIG_TEMP_MAX_DEVS) ///< maximum number of readings per stored sweep
+#define DS18B20_HISTORY_INVALID (INT16_MIN)                ///< stored in place of a reading that failed
+#define DS18B20_HISTORY_READING_MAX_BITS (3 + 17)          ///< widest code of one reading, its width prefix and value
+
+/// Worst case size of an encoded sweep in bytes, including the length prefix
+#define DS18B20_HISTORY_RECORD_MAX_BYTES \
+    (2 + ((1 + 16) + (4 + 64) + DS18B20_HISTORY_MAX_DEVICES * DS18B20_HISTORY_READING_MAX_BITS + 7) / 8)
+
+    /**
+ * @brief Callback invoked for every stored sweep by ds18b20_history_iterate().
+ * @param[in] time_ms Timestamp of the sweep in milliseconds.
+ * @param[in] values Raw readings of the sweep, in 1/16 degrees Celsius, DS18B20_HISTORY_INVALID where a read failed.
+ * @param[in] count Number of readings in values.
+ * @param[in] arg User argument passed to ds18b20_history_iterate().
+ * @return True to continue iterating, false to stop.
+ */
+    typedef bool (*DS18B20_HistoryCallback)(int64_t time_ms, const int16_t *values, int count, void *arg);
+
+    /**
+ * @brief Decoder state carried from one stored sweep to the next.
+ */
+    typedef struct
+    {
+        int64_t last_time_ms;                             ///< Timestamp of the previous sweep
+        int64_t last_delta_ms;                            ///< Difference between the previous two timestamps
+        uint16_t last_count;                              ///< Number of readings in the previous sweep
+        int16_t last_values[DS18B20_HISTORY_MAX_DEVICES]; ///< Readings of the previous sweep
+    } DS18B20_HistoryCodec;
+
+    /**
+ * @brief Structure containing the state of an open history store.
+ */
+    typedef struct
+    {
+        bool init;                                        ///< True if the store has been opened, otherwise false
+#ifdef CONFIG_IDF_TARGET_LINUX
+        FILE *file;                                       ///< Backing file on host builds
+#else
+        const void *partition;                            ///< Backing flash partition (esp_partition_t)
+#endif
+        uint32_t segment_count;                           ///< Number of segments in the backing storage
+        uint32_t active_segment;                          ///< Index of the segment currently appended to
+        uint32_t sequence;                                ///< Sequence number of the active segment
+        uint32_t write_offset;                            ///< Offset of the next record within the active segment
+        DS18B20_HistoryCodec codec;                       ///< Encoder state of the active segment
+        uint8_t record[DS18B20_HISTORY_RECORD_MAX_BYTES]; ///< Encoding buffer for a single sweep
+    } DS18B20_History;
+
+    /**
+ * @brief Open the history store and recover the append position from storage.
+ *
+ * The backing storage is the partition labelled CONFIG_TEMP_HISTORY_PARTITION_LABEL, or the
+ * file CONFIG_TEMP_HISTORY_FILE on host builds. Storage without any valid segment is formatted.
+ * @param[in] history Pointer to history instance.
+ * @return DS18B20_OK if the store is ready for use, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_history_open(DS18B20_History *history);
+
+    /**
+ * @brief Close the history store. Stored data is retained.
+ * @param[in] history Pointer to history instance.
+ */
+    void ds18b20_history_close(DS18B20_History *history);
+
+    /**
+ * @brief Append a sweep of raw readings to the store.
+ *
+ * Once the store is full the oldest segment is erased to make room.
+ * @param[in] history Pointer to history instance.
+ * @param[in] time_ms Timestamp of the sweep in milliseconds.
+ * @param[in] values Raw readings, in 1/16 degrees Celsius.
+ * @param[in] errors Read result of each reading, or NULL if all readings are valid.
+ *                   Readings with an error are stored as DS18B20_HISTORY_INVALID.
+ * @param[in] count Number of readings, at most DS18B20_HISTORY_MAX_DEVICES.
+ * @return DS18B20_OK if the sweep was stored, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_history_append(DS18B20_History *history, int64_t time_ms, const int16_t *values,
+                                         const DS18B20_ERROR *errors, int count);
+
+    /**
+ * @brief Decode all stored sweeps, oldest first.
+ * @param[in] history Pointer to history instance.
+ * @param[in] callback Function called for each stored sweep.
+ * @param[in] arg User argument passed through to callback.
+ * @return DS18B20_OK if all segments were read, otherwise error.
+ * @note The callback must not append to the same store.
+ */
+    DS18B20_ERROR ds18b20_history_iterate(DS18B20_History *history, DS18B20_HistoryCallback callback, void *arg);
+
+    /**
+ * @brief Discard all stored sweeps.
+ * @param[in] history Pointer to history instance.
+ * @return DS18B20_OK if the store was erased, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_history_erase(DS18B20_History *history);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DS18B20_HISTORY_H
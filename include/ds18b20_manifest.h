@@ -0,0 +1,141 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_manifest.h
+ * @brief Verification of the devices found on a bus against a manifest of expected ROM codes.
+ *
+ * A manifest is checked in one pass against the result of a single bus search, rather than
+ * with one verify search per expected device. The result lists the expected devices that are
+ * missing and the found devices that are not in the manifest.
+ */
+
+#ifndef DS18B20_MANIFEST_H
+#define DS18B20_MANIFEST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "owb.h"
+#include "ds18b20.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define DS18B20_MANIFEST_MAX_DEVICES (CONFIG_TEMP_MAX_DEVS) ///< maximum number of expected or found devices
+
+    /**
+ * @brief A ROM code as a number, for ordering, and its position in the list it came from.
+ */
+    typedef struct
+    {
+        uint64_t key; ///< ROM code as a number
+        int index;    ///< Position of the ROM code in its list
+    } DS18B20_ManifestKey;
+
+    /**
+ * @brief Result of checking devices against a manifest.
+ */
+    typedef struct
+    {
+        int expected_count;                                          ///< Number of devices in the manifest
+        int present_count;                                           ///< Number of expected devices that were found
+        int missing_count;                                           ///< Number of expected devices that were not found
+        int unexpected_count;                                        ///< Number of found devices not in the manifest
+        OneWireBus_ROMCode missing[DS18B20_MANIFEST_MAX_DEVICES];    ///< Expected devices that were not found
+        OneWireBus_ROMCode unexpected[DS18B20_MANIFEST_MAX_DEVICES]; ///< Found devices not in the manifest
+        DS18B20_ManifestKey sorted[DS18B20_MANIFEST_MAX_DEVICES];    ///< Expected devices in key order, for ds18b20_manifest_add()
+        bool found[DS18B20_MANIFEST_MAX_DEVICES];                    ///< Expected devices added so far, in manifest order
+    } DS18B20_ManifestResult;
+
+    /**
+ * @brief Parse a manifest from text.
+ * @param[in] text ROM codes as printed by owb_string_from_rom_code, separated by commas or spaces.
+ * @param[out] rom_codes Parsed ROM codes.
+ * @param[in] size Number of ROM codes that fit in rom_codes.
+ * @return Number of ROM codes parsed, or -1 if the text is invalid or does not fit.
+ */
+    int ds18b20_manifest_parse(const char *text, OneWireBus_ROMCode *rom_codes, int size);
+
+    /**
+ * @brief Check the result of a bus search against a manifest.
+ * @param[in] expected ROM codes in the manifest.
+ * @param[in] expected_count Number of ROM codes in the manifest.
+ * @param[in] found ROM codes found by the search.
+ * @param[in] found_count Number of ROM codes found.
+ * @param[out] result Missing and unexpected devices.
+ * @return DS18B20_OK if exactly the expected devices were found, DS18B20_ERROR_DEVICE if any are
+ *         missing or unexpected, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_manifest_check(const OneWireBus_ROMCode *expected, int expected_count,
+                                         const OneWireBus_ROMCode *found, int found_count,
+                                         DS18B20_ManifestResult *result);
+
+    /**
+ * @brief Start checking devices against a manifest one at a time, as a search finds them.
+ * @param[in] expected ROM codes in the manifest.
+ * @param[in] expected_count Number of ROM codes in the manifest.
+ * @param[out] result Every expected device missing, until added with ds18b20_manifest_add().
+ *                    The manifest is sorted once here, so each add is a binary search.
+ * @return DS18B20_OK on success, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_manifest_begin(const OneWireBus_ROMCode *expected, int expected_count,
+                                         DS18B20_ManifestResult *result);
+
+    /**
+ * @brief Add a found device to a check started with ds18b20_manifest_begin().
+ * @param[in,out] result Missing and unexpected devices so far.
+ * @param[in] rom_code ROM code of the found device.
+ */
+    void ds18b20_manifest_add(DS18B20_ManifestResult *result, OneWireBus_ROMCode rom_code);
+
+    /**
+ * @brief Finish a check started with ds18b20_manifest_begin() and log the result.
+ * @param[in,out] result Missing and unexpected devices, the missing ones listed in manifest order.
+ * @return DS18B20_OK if exactly the expected devices were added, DS18B20_ERROR_DEVICE if any are
+ *         missing or unexpected.
+ */
+    DS18B20_ERROR ds18b20_manifest_end(DS18B20_ManifestResult *result);
+
+    /**
+ * @brief Verify each device in a manifest with a targeted search.
+ *        Cheaper than a full search when only a few devices are expected, but cannot find
+ *        unexpected devices.
+ * @param[in] bus Pointer to the 1-Wire bus to verify devices on.
+ * @param[in] expected ROM codes in the manifest.
+ * @param[in] expected_count Number of ROM codes in the manifest.
+ * @param[out] result Missing devices, unexpected_count is always zero.
+ * @return DS18B20_OK if every expected device was found, DS18B20_ERROR_DEVICE if any are
+ *         missing, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_manifest_verify(const OneWireBus *bus, const OneWireBus_ROMCode *expected, int expected_count,
+                                          DS18B20_ManifestResult *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DS18B20_MANIFEST_H
@@ -0,0 +1,137 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_planner.h
+ * @brief Earliest-deadline-first planning of the conversions, waits and reads of a sweep.
+ *
+ * A plan is built from a set of devices, each with a deadline measured from the start of the
+ * sweep. The planner compares one skip-ROM conversion of the whole bus against addressed
+ * conversions, orders the reads earliest deadline first, and inserts the waits that conversions
+ * need. Of the strategies that meet every deadline it keeps the one that occupies the bus for
+ * the least time, counting the time the strong pull-up holds the bus for parasitic devices.
+ * The plan is a list of steps that can be inspected before it is executed.
+ */
+
+#ifndef DS18B20_PLANNER_H
+#define DS18B20_PLANNER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ds18b20.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define DS18B20_PLAN_MAX_DEVICES (CONFIG_TEMP_MAX_DEVS)           ///< maximum number of devices in a plan
+#define DS18B20_PLAN_MAX_STEPS (3 * DS18B20_PLAN_MAX_DEVICES + 2) ///< enough steps for any strategy
+
+    /**
+ * @brief Kinds of step in a plan.
+ */
+    typedef enum
+    {
+        DS18B20_STEP_CONVERT_ALL, ///< Start a conversion on every device with a skip ROM command
+        DS18B20_STEP_CONVERT,     ///< Start the conversion of one device
+        DS18B20_STEP_WAIT,        ///< Wait until the step's time, with the bus idle or held by the strong pull-up
+        DS18B20_STEP_READ,        ///< Read the temperature of one device
+    } DS18B20_STEP;
+
+    /**
+ * @brief Ways of ordering the conversions of a sweep.
+ */
+    typedef enum
+    {
+        DS18B20_STRATEGY_CONVERT_ALL,    ///< Convert the whole bus at once, then read every device
+        DS18B20_STRATEGY_EXTERNAL_FIRST, ///< Convert and read externally powered devices by address, then convert the whole bus for the parasitic ones
+        DS18B20_STRATEGY_ADDRESSED,      ///< Convert every device by address in deadline order, a parasitic device holds the bus until it is read
+    } DS18B20_STRATEGY;
+
+    /**
+ * @brief A device to sample and the time its reading is needed by.
+ */
+    typedef struct
+    {
+        const DS18B20_Info *device; ///< Device to sample, its resolution, power mode and CRC setting are planned for
+        int32_t deadline_us;        ///< Time from the start of the sweep by which the read must be complete
+    } DS18B20_PlanRequest;
+
+    /**
+ * @brief One step of a plan.
+ */
+    typedef struct
+    {
+        uint8_t type;    ///< The DS18B20_STEP to take
+        int16_t request; ///< Index of the request the step acts on, -1 for the whole bus
+        int32_t at_us;   ///< Time from the start of the sweep when the step starts, or a wait ends
+    } DS18B20_PlanStep;
+
+    /**
+ * @brief A planned sweep.
+ */
+    typedef struct
+    {
+        DS18B20_STRATEGY strategy;                         ///< Strategy chosen
+        int count;                                         ///< Number of requests planned for
+        int step_count;                                    ///< Number of steps
+        int missed;                                        ///< Number of requests planned to finish after their deadline
+        int32_t total_us;                                  ///< Time from the first step to the end of the last read
+        int32_t bus_us;                                    ///< Time the bus is driven or held by the strong pull-up
+        DS18B20_PlanStep steps[DS18B20_PLAN_MAX_STEPS];    ///< Steps in the order they are taken
+        int32_t ready_us[DS18B20_PLAN_MAX_DEVICES];        ///< Time each request's conversion is complete
+        int32_t finish_us[DS18B20_PLAN_MAX_DEVICES];       ///< Time each request's read is complete
+    } DS18B20_Plan;
+
+    /**
+ * @brief Estimate how long a device takes to convert.
+ * @param[in] device The device, its resolution and allowed overtime are used.
+ * @return The maximum conversion time in microseconds.
+ */
+    int32_t ds18b20_plan_conversion_us(const DS18B20_Info *device);
+
+    /**
+ * @brief Build the plan that meets every deadline with the least bus time.
+ *        If no strategy meets every deadline, the one that misses the fewest, soonest, is chosen.
+ * @param[in] requests The devices to sample and their deadlines.
+ * @param[in] count Number of requests.
+ * @param[out] plan The plan.
+ * @return DS18B20_OK if every deadline is met, DS18B20_ERROR_TIMEOUT if the plan misses some,
+ *         otherwise error.
+ */
+    DS18B20_ERROR ds18b20_plan_build(const DS18B20_PlanRequest *requests, int count, DS18B20_Plan *plan);
+
+    /**
+ * @brief Print a plan, one step per line.
+ * @param[in] plan The plan.
+ */
+    void ds18b20_plan_log(const DS18B20_Plan *plan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DS18B20_PLANNER_H
@@ -0,0 +1,128 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_registry.h
+ * @brief Registry mapping device ROM codes to stable logical indices, names and locations.
+ *
+ * Entries are looked up in constant time through an open-addressing hash table keyed on the
+ * 64-bit ROM code, so consumers never need to scan device arrays comparing ROM codes.
+ *
+ * A registry can be loaded from a compact binary blob, for example stored in NVS or embedded
+ * in the firmware. All fields are little endian:
+ *
+ *     "DSR1" | count (u16) | count * { rom code (8) | index (u16) | name length (u8) | name |
+ *                                      location length (u8) | location }
+ */
+
+#ifndef DS18B20_REGISTRY_H
+#define DS18B20_REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "owb.h"
+#include "ds18b20.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef CONFIG_TEMP_REGISTRY_TEXT_LENGTH
+#define DS18B20_REGISTRY_TEXT_LENGTH (CONFIG_TEMP_REGISTRY_TEXT_LENGTH) ///< storage for a name or location, including the terminator
+#else
+#define DS18B20_REGISTRY_TEXT_LENGTH (16) ///< storage for a name or location, including the terminator
+#endif
+
+    /**
+ * @brief Information about one registered device.
+ */
+    typedef struct
+    {
+        OneWireBus_ROMCode rom_code;                 ///< ROM code identifying the device
+        uint16_t index;                              ///< Stable logical index of the device
+        char name[DS18B20_REGISTRY_TEXT_LENGTH];     ///< Human readable name, may be empty
+        char location[DS18B20_REGISTRY_TEXT_LENGTH]; ///< Installation location, may be empty
+    } DS18B20_RegistryEntry;
+
+    /**
+ * @brief Structure containing a registry of devices.
+ */
+    typedef struct
+    {
+        int count;                      ///< Number of registered devices
+        int capacity;                   ///< Most devices that can be registered
+        int slot_count;                 ///< Size of the hash table, a power of two
+        DS18B20_RegistryEntry *entries; ///< Registered devices in order of registration
+        int16_t *slots;                 ///< Hash table of indices into entries, -1 if empty
+    } DS18B20_Registry;
+
+    /**
+ * @brief Construct a new, empty registry.
+ * @param[in] capacity Most devices that can be registered.
+ * @return Pointer to new registry, or NULL if it cannot be created.
+ */
+    DS18B20_Registry *ds18b20_registry_malloc(int capacity);
+
+    /**
+ * @brief Delete an existing registry.
+ * @param[in,out] registry Pointer to registry that will be freed and set to NULL.
+ */
+    void ds18b20_registry_free(DS18B20_Registry **registry);
+
+    /**
+ * @brief Register a device.
+ * @param[in] registry Pointer to registry.
+ * @param[in] rom_code ROM code of the device, which must not already be registered.
+ * @param[in] index Stable logical index of the device.
+ * @param[in] name Human readable name, truncated to fit, may be NULL.
+ * @param[in] location Installation location, truncated to fit, may be NULL.
+ * @return DS18B20_OK if the device was registered, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_registry_add(DS18B20_Registry *registry, OneWireBus_ROMCode rom_code, uint16_t index,
+                                       const char *name, const char *location);
+
+    /**
+ * @brief Register every device described by a configuration blob.
+ * @param[in] registry Pointer to registry.
+ * @param[in] blob Configuration blob in the format described above.
+ * @param[in] length Size of the blob in bytes.
+ * @return DS18B20_OK if the whole blob was loaded, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_registry_load(DS18B20_Registry *registry, const uint8_t *blob, size_t length);
+
+    /**
+ * @brief Find a registered device by ROM code.
+ * @param[in] registry Pointer to registry.
+ * @param[in] rom_code ROM code to look up.
+ * @return Pointer to the entry for the device, or NULL if it is not registered.
+ */
+    const DS18B20_RegistryEntry *ds18b20_registry_lookup(const DS18B20_Registry *registry, OneWireBus_ROMCode rom_code);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DS18B20_REGISTRY_H
@@ -0,0 +1,153 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_rollup.h
+ * @brief Multi-level min/max/mean/count rollups of temperature sweeps.
+ *
+ * Every sweep updates one bucket per device at each of three levels: seconds, minutes and hours.
+ * Each level is a ring of buckets, so the memory used is fixed when the rollup is created.
+ * Range queries combine the coarsest buckets that fit inside the range with finer buckets at its
+ * edges, so the cost depends on the number of buckets touched rather than the number of samples.
+ */
+
+#ifndef DS18B20_ROLLUP_H
+#define DS18B20_ROLLUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ds18b20.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define DS18B20_ROLLUP_LEVELS 3 ///< number of bucket levels: seconds, minutes and hours
+
+    /**
+ * @brief Aggregate of the readings in one bucket.
+ */
+    typedef struct
+    {
+        int16_t min;    ///< Lowest reading, in 1/16 degrees Celsius
+        int16_t max;    ///< Highest reading, in 1/16 degrees Celsius
+        int32_t sum;    ///< Sum of all readings, in 1/16 degrees Celsius
+        uint32_t count; ///< Number of readings, zero if the bucket is empty
+    } DS18B20_RollupBucket;
+
+#define DS18B20_ROLLUP_DEVICE_SIZE ((CONFIG_TEMP_ROLLUP_SECONDS + CONFIG_TEMP_ROLLUP_MINUTES + CONFIG_TEMP_ROLLUP_HOURS) * \
+                                    sizeof(DS18B20_RollupBucket)) ///< heap taken by the buckets of each device
+
+    /**
+ * @brief One ring of equally sized buckets.
+ */
+    typedef struct
+    {
+        uint32_t width_ms;             ///< Time covered by each bucket
+        int length;                    ///< Number of buckets kept per device
+        int64_t newest;                ///< Highest bucket number added so far, -1 if none
+        int64_t *bucket_numbers;       ///< Bucket number (time / width) held by each slot, -1 if unused
+        DS18B20_RollupBucket *buckets; ///< Buckets of all devices, indexed by device * length + slot
+    } DS18B20_RollupLevel;
+
+    /**
+ * @brief Structure containing the rollups of a set of devices.
+ */
+    typedef struct
+    {
+        int devices;                                       ///< Number of devices tracked
+        DS18B20_RollupLevel levels[DS18B20_ROLLUP_LEVELS]; ///< Levels from finest to coarsest
+    } DS18B20_Rollup;
+
+    /**
+ * @brief Result of a rollup range query.
+ */
+    typedef struct
+    {
+        int16_t min;      ///< Lowest reading in the range, in 1/16 degrees Celsius
+        int16_t max;      ///< Highest reading in the range, in 1/16 degrees Celsius
+        int16_t mean;     ///< Mean of the readings in the range, in 1/16 degrees Celsius
+        uint32_t count;   ///< Number of readings in the range
+        bool approximate; ///< True if an edge came from a whole coarse bucket, which may add readings just outside the range
+    } DS18B20_RollupStats;
+
+    /**
+ * @brief Construct a new rollup instance.
+ *
+ * Bucket counts per level are CONFIG_TEMP_ROLLUP_SECONDS, CONFIG_TEMP_ROLLUP_MINUTES and CONFIG_TEMP_ROLLUP_HOURS.
+ * @param[in] devices Number of devices to track.
+ * @return Pointer to new rollup instance, or NULL if it cannot be created.
+ */
+    DS18B20_Rollup *ds18b20_rollup_malloc(int devices);
+
+    /**
+ * @brief Delete an existing rollup instance.
+ * @param[in,out] rollup Pointer to rollup instance that will be freed and set to NULL.
+ */
+    void ds18b20_rollup_free(DS18B20_Rollup **rollup);
+
+    /**
+ * @brief Get the heap held by a rollup instance.
+ * @param[in] rollup Pointer to rollup instance, or NULL.
+ * @return Size in bytes, 0 for NULL.
+ */
+    size_t ds18b20_rollup_size(const DS18B20_Rollup *rollup);
+
+    /**
+ * @brief Add a sweep of readings to all levels.
+ *
+ * Readings outside the measurement range of the device, or with an error, are skipped.
+ * Sweeps older than the newest bucket held by a slot are ignored at that level.
+ * @param[in] rollup Pointer to rollup instance.
+ * @param[in] time_ms Timestamp of the sweep in milliseconds, not negative.
+ * @param[in] values Raw readings, in 1/16 degrees Celsius.
+ * @param[in] errors Read result of each reading, or NULL if all readings are valid.
+ * @param[in] count Number of readings, readings beyond the tracked devices are ignored.
+ */
+    void ds18b20_rollup_add(DS18B20_Rollup *rollup, int64_t time_ms, const int16_t *values,
+                            const DS18B20_ERROR *errors, int count);
+
+    /**
+ * @brief Aggregate the readings of one device between two times.
+ *
+ * Whole coarse buckets are used where they fit inside the range and the edges are resolved by the
+ * finer levels. An edge older than the retention of the finer levels is taken from the coarse buckets
+ * overlapping it, and stats.approximate is set, as they may hold readings up to one bucket outside the range.
+ * @param[in] rollup Pointer to rollup instance.
+ * @param[in] device Index of the device.
+ * @param[in] from_ms Start of the range, inclusive.
+ * @param[in] to_ms End of the range, exclusive.
+ * @param[out] stats Aggregate of the range, count is zero if no readings were found.
+ * @return DS18B20_OK if the query is successful, otherwise error.
+ */
+    DS18B20_ERROR ds18b20_rollup_query(const DS18B20_Rollup *rollup, int device, int64_t from_ms, int64_t to_ms,
+                                       DS18B20_RollupStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DS18B20_ROLLUP_H
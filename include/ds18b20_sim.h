@@ -0,0 +1,212 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_sim.h
+ * @brief Simulated 1-Wire bus of DS18B20 devices with fault injection, for host tests and benchmarks.
+ *
+ * The simulation is an esp32-owb driver, so ds18b20.c and the wrapper run against it unchanged.
+ * Devices are emulated at the level of individual time slots: ROM commands including search,
+ * scratchpad reads and writes, conversions that hold the bus low until they complete, and
+ * parasitic devices that lose their conversion if the bus is used before it completes.
+ *
+ * Bus time is the time really spent waiting plus a nominal standard-speed duration for every
+ * reset and time slot, so the bus occupancy of a workload can be measured on a fast host.
+ * Faults are drawn from a seeded pseudo-random generator, so a run can be repeated exactly,
+ * and can be changed at set bus times through a script.
+ */
+
+#ifndef DS18B20_SIM_H
+#define DS18B20_SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "owb.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef CONFIG_TEMP_SIM_MAX_DEVICES
+#define DS18B20_SIM_MAX_DEVICES (CONFIG_TEMP_SIM_MAX_DEVICES) ///< maximum number of simulated devices per bus
+#else
+#define DS18B20_SIM_MAX_DEVICES (8) ///< maximum number of simulated devices per bus
+#endif
+
+    /**
+ * @brief Faults injected on the whole bus. Rates are in parts per million.
+ */
+    typedef struct
+    {
+        uint32_t bit_error_ppm;        ///< Chance of each written or read bit being flipped
+        uint32_t presence_failure_ppm; ///< Chance of a reset missing the presence pulse
+        uint32_t power_on_ppm;         ///< Chance of a conversion leaving the 85 degrees C power-on value
+        uint32_t vanish_ppm;           ///< Chance of each device dropping off the bus at a reset
+        int64_t vanish_us;             ///< How long a device that dropped off stays away
+        bool stuck_low;                ///< Bus held low: reads return 0 and resets see no presence
+    } DS18B20_SimFaults;
+
+    /**
+ * @brief Changes a script can make to the simulation.
+ */
+    typedef enum
+    {
+        DS18B20_SIM_SET_PRESENT,              ///< Connect (value 1) or disconnect (value 0) a device
+        DS18B20_SIM_SET_TEMPERATURE,          ///< Set the temperature of a device, value in 1/16 degrees C
+        DS18B20_SIM_SET_CONVERSION_PERCENT,   ///< Scale the conversion time of a device, value in percent
+        DS18B20_SIM_POWER_ON_RESET,           ///< Power cycle a device, restoring its power-on scratchpad
+        DS18B20_SIM_SET_BIT_ERROR_PPM,        ///< Set DS18B20_SimFaults.bit_error_ppm
+        DS18B20_SIM_SET_PRESENCE_FAILURE_PPM, ///< Set DS18B20_SimFaults.presence_failure_ppm
+        DS18B20_SIM_SET_STUCK_LOW,            ///< Set DS18B20_SimFaults.stuck_low
+    } DS18B20_SIM_ACTION;
+
+    /**
+ * @brief One scripted change, applied once bus time reaches time_us.
+ */
+    typedef struct
+    {
+        int64_t time_us;           ///< Bus time of the change
+        int device;                ///< Index of the device, ignored by bus-wide actions
+        DS18B20_SIM_ACTION action; ///< What to change
+        int32_t value;             ///< New value
+    } DS18B20_SimEvent;
+
+    /**
+ * @brief State of one simulated device.
+ */
+    typedef struct
+    {
+        OneWireBus_ROMCode rom_code; ///< ROM code of the device
+        bool present;                ///< True if connected to the bus
+        bool parasitic;              ///< True if powered through the data line
+        int16_t temperature;         ///< Temperature the next conversion measures, in 1/16 degrees C
+        uint16_t conversion_percent; ///< Conversion time relative to the datasheet maximum, in percent
+        uint8_t scratchpad[9];       ///< Scratchpad memory, including CRC
+        uint8_t eeprom[3];           ///< TH, TL and configuration stored by Copy Scratchpad
+        int64_t absent_until_us;     ///< Bus time until which the device has dropped off the bus
+        int64_t conversion_end_us;   ///< Bus time at which the current conversion completes
+        bool converting;             ///< True while a conversion runs, which a reset does not interrupt
+        uint8_t state;               ///< Protocol state
+        uint8_t next_state;          ///< Protocol state after the current transfer
+        uint8_t search_phase;        ///< Step within the current search bit
+        uint8_t byte;                ///< Bits received of the current byte
+        int bit_index;               ///< Bits transferred in the current state
+        const uint8_t *send;         ///< Data being sent to the master
+        int send_bits;               ///< Length of the data being sent, in bits
+        uint8_t power_bit;           ///< Response to Read Power Supply
+    } DS18B20_SimDevice;
+
+    /**
+ * @brief Bus traffic and injected faults since the bus was initialised.
+ */
+    typedef struct
+    {
+        uint32_t resets;          ///< Resets issued
+        uint32_t bits_written;    ///< Write time slots issued
+        uint32_t bits_read;       ///< Read time slots issued
+        uint32_t flipped_bits;    ///< Bits corrupted by bit_error_ppm
+        uint32_t missed_presence; ///< Presence pulses lost to faults
+        uint32_t vanished;        ///< Devices that dropped off the bus through vanish_ppm
+        uint32_t power_on_values; ///< Conversions that left the power-on value
+    } DS18B20_SimStats;
+
+    /**
+ * @brief Simulated bus and the devices on it.
+ */
+    typedef struct
+    {
+        OneWireBus bus;                                     ///< Bus instance passed to the ds18b20 API
+        DS18B20_SimDevice devices[DS18B20_SIM_MAX_DEVICES]; ///< Simulated devices
+        int device_count;                                   ///< Number of simulated devices
+        DS18B20_SimFaults faults;                           ///< Faults currently injected
+        DS18B20_SimStats stats;                             ///< Traffic and fault counts
+        uint32_t random;                                    ///< State of the pseudo-random generator
+        int64_t start_us;                                   ///< esp_timer time when the bus was initialised
+        int64_t slot_time_us;                               ///< Nominal time spent in resets and time slots
+        const DS18B20_SimEvent *script;                     ///< Scripted changes, sorted by time
+        int script_length;                                  ///< Number of scripted changes
+        int script_next;                                    ///< Next scripted change to apply
+    } DS18B20_Sim;
+
+    /**
+ * @brief Initialise a simulated bus with no devices and no faults.
+ * @param[out] sim Pointer to the simulation.
+ * @param[in] seed Seed of the pseudo-random generator that draws faults.
+ * @return Pointer to the bus, to use in place of owb_rmt_initialize().
+ */
+    OneWireBus *ds18b20_sim_initialize(DS18B20_Sim *sim, uint32_t seed);
+
+    /**
+ * @brief Build a valid DS18B20 ROM code from a serial number.
+ * @param[in] serial 48-bit serial number.
+ * @return ROM code with the DS18B20 family code and a correct CRC.
+ */
+    OneWireBus_ROMCode ds18b20_sim_rom_code(uint64_t serial);
+
+    /**
+ * @brief Connect a new device to the bus, at power-on state with 12-bit resolution.
+ * @param[in] sim Pointer to the simulation.
+ * @param[in] rom_code ROM code of the device.
+ * @param[in] parasitic True if the device is powered through the data line.
+ * @param[in] temperature Temperature the device measures, in 1/16 degrees C.
+ * @return Index of the device, or -1 if the bus is full.
+ */
+    int ds18b20_sim_add_device(DS18B20_Sim *sim, OneWireBus_ROMCode rom_code, bool parasitic, int16_t temperature);
+
+    /**
+ * @brief Replace the faults injected on the bus.
+ * @param[in] sim Pointer to the simulation.
+ * @param[in] faults Faults to inject.
+ */
+    void ds18b20_sim_set_faults(DS18B20_Sim *sim, const DS18B20_SimFaults *faults);
+
+    /**
+ * @brief Set the script of changes to apply as bus time passes.
+ * @param[in] sim Pointer to the simulation.
+ * @param[in] script Changes sorted by time, which must outlive the simulation, or NULL.
+ * @param[in] length Number of changes.
+ */
+    void ds18b20_sim_set_script(DS18B20_Sim *sim, const DS18B20_SimEvent *script, int length);
+
+    /**
+ * @brief Apply a single change immediately.
+ * @param[in] sim Pointer to the simulation.
+ * @param[in] event Change to apply, time_us is ignored.
+ */
+    void ds18b20_sim_apply(DS18B20_Sim *sim, const DS18B20_SimEvent *event);
+
+    /**
+ * @brief Get the current bus time.
+ * @param[in] sim Pointer to the simulation.
+ * @return Microseconds since the bus was initialised, including nominal slot times.
+ */
+    int64_t ds18b20_sim_time_us(const DS18B20_Sim *sim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DS18B20_SIM_H
@@ -0,0 +1,110 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 wolffshots
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file ds18b20_trace.h
+ * @brief Record every low-level 1-Wire operation to a file, and replay recordings on the host.
+ *
+ * A recording bus wraps another bus, passes each reset, write and read through to it, and logs
+ * the operation with its result and a timestamp. A replaying bus answers the same operations
+ * from a recording, so a field issue can be reproduced and benchmarked deterministically on
+ * Linux by running the driver or wrapper against it.
+ *
+ * Each operation takes three to five bytes:
+ *
+ *     op (u8) | microseconds since the previous op (varint) | [data (u8)] | [status (u8)]
+ *
+ * where op holds the operation in bits 7-6 (0 reset, 1 write, 2 read), a status flag in bit 5,
+ * the presence result of a reset in bit 4 and the number of bits minus one in bits 2-0. Data
+ * follows writes and reads, and the status only follows operations that did not return
+ * OWB_STATUS_OK. The file starts with the four bytes "DST1".
+ */
+
+#ifndef DS18B20_TRACE_H
+#define DS18B20_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "owb.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+ * @brief Operations recorded or replayed since the trace was started.
+ */
+    typedef struct
+    {
+        uint32_t resets;      ///< Resets
+        uint32_t writes;      ///< Write operations, of one to eight bits each
+        uint32_t reads;       ///< Read operations, of one to eight bits each
+        uint32_t bytes;       ///< Bytes of the recording, including the file header
+        int64_t recorded_us;  ///< Time from the first to the last recorded operation
+        uint32_t divergences; ///< Replayed operations that did not match the recording
+    } DS18B20_TraceStats;
+
+    /**
+ * @brief Recording or replaying bus.
+ */
+    typedef struct
+    {
+        OneWireBus bus;           ///< Bus instance passed to the ds18b20 API
+        const OneWireBus *target; ///< Bus being recorded, NULL when replaying
+        FILE *file;               ///< Recording, opened and closed by the caller
+        int64_t last_us;          ///< Time of the previous operation, or -1 before the first
+        DS18B20_TraceStats stats; ///< Operation counts
+    } DS18B20_Trace;
+
+    /**
+ * @brief Start recording the operations on a bus.
+ * @param[out] trace Pointer to the trace.
+ * @param[in] target Initialised bus to record, for example from owb_rmt_initialize().
+ * @param[in] file File opened for binary writing.
+ * @return Pointer to a bus that records and forwards to target, or NULL on error.
+ */
+    OneWireBus *ds18b20_trace_record(DS18B20_Trace *trace, const OneWireBus *target, FILE *file);
+
+    /**
+ * @brief Start replaying a recording.
+ * @param[out] trace Pointer to the trace.
+ * @param[in] file File opened for binary reading.
+ * @return Pointer to a bus that answers from the recording, or NULL if the file is not a recording.
+ */
+    OneWireBus *ds18b20_trace_replay(DS18B20_Trace *trace, FILE *file);
+
+    /**
+ * @brief Finish a trace, flushing a recording. The file is left open.
+ * @param[in] trace Pointer to the trace.
+ */
+    void ds18b20_trace_close(DS18B20_Trace *trace);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DS18B20_TRACE_H
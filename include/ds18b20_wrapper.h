@@ -32,15 +32,99 @@
 #ifndef DS18B20_WRAPPER_H
 #define DS18B20_WRAPPER_H
 
+#include <stdint.h>
+
+#include "ds18b20_calibration.h"
+#include "ds18b20_diagnostics.h"
+#include "ds18b20_events.h"
+#include "ds18b20_history.h"
+#include "ds18b20_manifest.h"
+#include "ds18b20_planner.h"
+#include "ds18b20_registry.h"
+#include "ds18b20_rollup.h"
+#include "ds18b20_trace.h"
+
+#define DS18B20_FRAME_VALID_WORDS(devices) (((devices) + 31) / 32) ///< words needed for the validity mask of a frame
+#define DS18B20_FRAME_IS_VALID(frame, device) \
+    (((frame)->valid[(device) / 32] >> ((device) % 32)) & 1u) ///< true if the reading of a device in a frame is valid
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif // __cplusplus
 
+    /**
+ * @brief called for every reading that passes the reporting deadband
+ * @param device the index of the device
+ * @param value the reading in 1/16 degrees C
+ * @param arg the user argument given when the callback was set
+ */
+    typedef void (*DS18B20_PublishCallback)(int device, int16_t value, void *arg);
+
+    /**
+ * @brief caller-owned struct-of-arrays frame filled by ds18b20_wrapped_capture_frame
+ * each array holds at least capacity entries, valid at least DS18B20_FRAME_VALID_WORDS(capacity) words
+ */
+    typedef struct
+    {
+        int capacity;          ///< number of devices the arrays can hold, set by the caller
+        int count;             ///< number of devices written by the last capture
+        uint32_t sequence;     ///< sweep sequence number of the last capture
+        int16_t *readings;     ///< raw readings in 1/16 degrees C
+        DS18B20_ERROR *errors; ///< read result of each device
+        uint32_t *valid;       ///< bit per device, set if the reading is DS18B20_OK
+        int64_t *times_us;     ///< monotonic time each device was read, from esp_timer_get_time
+    } DS18B20_Frame;
+
+    /**
+ * @brief ram taken by the wrapper and the driver, filled by ds18b20_wrapped_memory
+ */
+    typedef struct
+    {
+        size_t static_size;        ///< static ram at CONFIG_TEMP_MAX_DEVS devices and the enabled features
+        size_t static_device_size; ///< static ram each device slot of CONFIG_TEMP_MAX_DEVS adds
+        size_t heap_size;          ///< heap held for the devices found and the enabled features
+        size_t heap_device_size;   ///< heap each device found adds
+        size_t stack_used_size;    ///< most stack the calling task has used
+    } DS18B20_Memory;
+
     int ds18b20_wrapped_init(void);
     void ds18b20_wrapped_deinit(void);
+    DS18B20_ERROR ds18b20_wrapped_restart(void);
+    void ds18b20_wrapped_shutdown(void);
     void ds18b20_wrapped_read(void);
     void ds18b20_wrapped_capture(float *results, int size);
+    void ds18b20_wrapped_capture_units(int32_t *results, int size, DS18B20_UNIT unit);
+    DS18B20_ERROR ds18b20_wrapped_capture_frame(DS18B20_Frame *frame);
+    void ds18b20_wrapped_set_publish_callback(DS18B20_PublishCallback callback, void *arg);
+    void ds18b20_wrapped_set_deadband(int16_t deadband, int32_t heartbeat_ms);
+    void ds18b20_wrapped_use_bus(OneWireBus *bus);
+    void ds18b20_wrapped_memory(DS18B20_Memory *memory, size_t stack_size);
+#ifdef CONFIG_TEMP_MANIFEST_CHECK
+    DS18B20_ERROR ds18b20_wrapped_set_manifest(const OneWireBus_ROMCode *rom_codes, int count);
+    const DS18B20_ManifestResult *ds18b20_wrapped_manifest_result(void);
+#endif
+#ifdef CONFIG_TEMP_DIAGNOSTICS
+    const DS18B20_Diagnostics *ds18b20_wrapped_diagnostics(void);
+#endif
+#ifdef CONFIG_TEMP_PLANNER
+    DS18B20_ERROR ds18b20_wrapped_set_deadline(int device, int32_t deadline_ms);
+    const DS18B20_Plan *ds18b20_wrapped_plan(void);
+#endif
+#ifdef CONFIG_TEMP_REGISTRY
+    void ds18b20_wrapped_set_registry(const DS18B20_Registry *device_registry);
+    const DS18B20_RegistryEntry *ds18b20_wrapped_entry(int device);
+#endif
+#ifdef CONFIG_TEMP_EVENTS
+    void ds18b20_wrapped_set_thresholds(int16_t low, int16_t high);
+#endif
+#ifdef CONFIG_TEMP_HISTORY
+    DS18B20_History *ds18b20_wrapped_history(void);
+#endif
+#ifdef CONFIG_TEMP_ROLLUP
+    DS18B20_Rollup *ds18b20_wrapped_rollup(void);
+    DS18B20_ERROR ds18b20_wrapped_query(int device, int64_t duration_ms, DS18B20_RollupStats *stats);
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,104 @@
+#!/bin/sh
+#
+# Measure the static ram each device slot costs the wrapper, rather than trusting the sum of
+# sizes in ds18b20_wrapper.c. The wrapper is compiled for the host against the stand-in headers
+# in test/stub at two CONFIG_TEMP_MAX_DEVS values, and the growth of its static data between them
+# is the measured cost per slot. The build then fails if DEVICE_STATIC_SIZE, which
+# ds18b20_wrapped_memory reports and CONFIG_TEMP_DEVICE_RAM_BUDGET is checked against, is smaller,
+# as it is when a new per-device array is left out of the sum.
+#
+# Both the default options and every feature enabled are checked. Pointers are host sized, so the
+# figures are at least those of the target.
+#
+# usage: test/ram_budget.sh, with CC and NM to override the host tools
+
+set -e
+cd "$(dirname "$0")/.."
+CC=${CC:-cc}
+NM=${NM:-nm}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# device counts that are multiples of 8 keep the padding of structs holding per-device arrays alike
+LOW_DEVS=8
+HIGH_DEVS=16
+
+cat > "$WORK/default.h" <<'EOF'
+#define CONFIG_TEMP_OWB_GPIO 14
+#define CONFIG_TEMP_DEVICE_RAM_BUDGET 384
+#define CONFIG_TEMP_WRAPPER_TAG "esp32-ds18b20_wrapper"
+#define CONFIG_TEMP_TAG "esp32-ds18b20"
+#define CONFIG_TEMP_SAMPLE_PERIOD 1000
+#define CONFIG_TEMP_CONVERSION_OVERTIME 10
+#define CONFIG_TEMP_TIMEOUT_POLICY_IGNORE 1
+#define CONFIG_TEMP_CONVERSION_RETRIES 1
+#define CONFIG_TEMP_CONVERSION_POLL_INTERVAL 1000
+#define CONFIG_TEMP_REPORT_DEADBAND -1
+#define CONFIG_TEMP_REPORT_HEARTBEAT 60000
+EOF
+
+{
+    grep -v CONFIG_TEMP_DEVICE_RAM_BUDGET "$WORK/default.h"
+    cat <<'EOF'
+#define CONFIG_TEMP_DEVICE_RAM_BUDGET 4096
+#define CONFIG_TEMP_CALIBRATION 1
+#define CONFIG_TEMP_CALIBRATION_MAX 16
+#define CONFIG_TEMP_DIAGNOSTICS 1
+#define CONFIG_TEMP_DIAGNOSTICS_WINDOW 64
+#define CONFIG_TEMP_DIAGNOSTICS_DEGRADED_SCORE 90
+#define CONFIG_TEMP_DIAGNOSTICS_POOR_SCORE 60
+#define CONFIG_TEMP_DIAGNOSTICS_SLOWDOWN 2
+#define CONFIG_TEMP_GROUPS 1
+#define CONFIG_TEMP_PLANNER 1
+#define CONFIG_TEMP_PLANNER_DEADLINE 1000
+#define CONFIG_TEMP_BUS_LOCK 1
+#define CONFIG_TEMP_MAX_BUSES 2
+#define CONFIG_TEMP_ARBITER 1
+#define CONFIG_TEMP_ARBITER_QUEUE_LENGTH 16
+#define CONFIG_TEMP_ARBITER_STACK_SIZE 3072
+#define CONFIG_TEMP_EVENTS 1
+#define CONFIG_TEMP_EVENT_SNAPSHOTS 2
+#define CONFIG_TEMP_HISTORY 1
+#define CONFIG_TEMP_HISTORY_PARTITION_LABEL "ds18b20_hist"
+#define CONFIG_TEMP_HISTORY_FILE "ds18b20_history.bin"
+#define CONFIG_TEMP_HISTORY_FILE_SIZE 262144
+#define CONFIG_TEMP_HISTORY_SEGMENT_SIZE 4096
+#define CONFIG_TEMP_ROLLUP 1
+#define CONFIG_TEMP_ROLLUP_SECONDS 120
+#define CONFIG_TEMP_ROLLUP_MINUTES 120
+#define CONFIG_TEMP_ROLLUP_HOURS 48
+#define CONFIG_TEMP_SIM 1
+#define CONFIG_TEMP_SIM_MAX_DEVICES 256
+#define CONFIG_TEMP_BENCH 1
+#define CONFIG_TEMP_TRACE 1
+#define CONFIG_TEMP_TRACE_RECORD 1
+#define CONFIG_TEMP_TRACE_FILE "/spiffs/ds18b20.trace"
+#define CONFIG_TEMP_REGISTRY 1
+#define CONFIG_TEMP_REGISTRY_TEXT_LENGTH 16
+#define CONFIG_TEMP_MANIFEST_CHECK 1
+#define CONFIG_TEMP_MANIFEST ""
+EOF
+} > "$WORK/all.h"
+
+# bytes of static data in the wrapper built with the options in $1 and $2 device slots
+static_size()
+{
+    $CC -c -std=gnu11 -w -Itest/stub -Iinclude -include "$1" -DCONFIG_TEMP_MAX_DEVS="$2" \
+        ds18b20_wrapper.c -o "$WORK/wrapper.o"
+    $NM -S -t d "$WORK/wrapper.o" | awk '$3 ~ /^[bBdD]$/ { sum += $2 } END { print sum + 0 }'
+}
+
+for config in default all; do
+    low=$(static_size "$WORK/$config.h" $LOW_DEVS)
+    high=$(static_size "$WORK/$config.h" $HIGH_DEVS)
+    measured=$(((high - low) / (HIGH_DEVS - LOW_DEVS)))
+    echo "$config: $measured bytes of static ram per device slot"
+
+    cat > "$WORK/check.c" <<EOF
+#include "$PWD/ds18b20_wrapper.c"
+_Static_assert(DEVICE_STATIC_SIZE >= $measured, "DEVICE_STATIC_SIZE misses static ram the wrapper takes per device");
+EOF
+    $CC -fsyntax-only -std=gnu11 -w -Itest/stub -Iinclude -include "$WORK/$config.h" \
+        -DCONFIG_TEMP_MAX_DEVS=$LOW_DEVS "$WORK/check.c"
+done
+echo "ram budget check passed"
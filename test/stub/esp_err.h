@@ -0,0 +1,6 @@
+// host stand-in for the ESP-IDF header, declaring only what test/ram_budget.sh compiles against
+#pragma once
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+const char *esp_err_to_name(esp_err_t code);
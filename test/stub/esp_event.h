@@ -0,0 +1,12 @@
+// host stand-in for the ESP-IDF header, declaring only what test/ram_budget.sh compiles against
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+typedef const char *esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *arg, esp_event_base_t base, int32_t id, void *data);
+#define ESP_EVENT_DECLARE_BASE(id) extern esp_event_base_t const id
+#define ESP_EVENT_DEFINE_BASE(id) esp_event_base_t const id = #id
+#define ESP_EVENT_ANY_ID -1
+esp_err_t esp_event_post(esp_event_base_t base, int32_t id, const void *data, size_t size, TickType_t wait);
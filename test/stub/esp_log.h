@@ -0,0 +1,8 @@
+// host stand-in for the ESP-IDF header, declaring only what test/ram_budget.sh compiles against
+#pragma once
+#include <stdio.h>
+#define ESP_LOGE(tag, ...) printf(__VA_ARGS__)
+#define ESP_LOGW(tag, ...) printf(__VA_ARGS__)
+#define ESP_LOGI(tag, ...) printf(__VA_ARGS__)
+#define ESP_LOGD(tag, ...) printf(__VA_ARGS__)
+#define ESP_LOGV(tag, ...) printf(__VA_ARGS__)
@@ -0,0 +1,2 @@
+// host stand-in for the ESP-IDF header, declaring only what test/ram_budget.sh compiles against
+#pragma once
@@ -0,0 +1,23 @@
+// host stand-in for the ESP-IDF header, declaring only what test/ram_budget.sh compiles against
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+typedef struct esp_timer *esp_timer_handle_t;
+typedef enum
+{
+    ESP_TIMER_TASK,
+} esp_timer_dispatch_t;
+typedef struct
+{
+    void (*callback)(void *arg);
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+int64_t esp_timer_get_time(void);
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *timer);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
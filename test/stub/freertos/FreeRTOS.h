@@ -0,0 +1,26 @@
+// host stand-in for the ESP-IDF header, declaring only what test/ram_budget.sh compiles against
+#pragma once
+#include <stdint.h>
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef unsigned UBaseType_t;
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+typedef struct
+{
+    void *reserved[20];
+} StaticSemaphore_t;
+typedef struct
+{
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+#define portMAX_DELAY 0xffffffffu
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms) * configTICK_RATE_HZ / 1000)
+#define configTICK_RATE_HZ 100
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
@@ -0,0 +1,7 @@
+// host stand-in for the ESP-IDF header, declaring only what test/ram_budget.sh compiles against
+#pragma once
+#include "FreeRTOS.h"
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t period);
+TickType_t xTaskGetTickCount(void);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
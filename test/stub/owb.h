@@ -0,0 +1,54 @@
+// host stand-in for the esp32-owb header, declaring only what test/ram_budget.sh compiles against
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+typedef int gpio_num_t;
+#define GPIO_NUM_NC (-1)
+typedef enum
+{
+    OWB_STATUS_OK,
+    OWB_STATUS_NOT_INITIALIZED,
+    OWB_STATUS_PARAMETER_NULL,
+    OWB_STATUS_DEVICE_NOT_RESPONDING,
+    OWB_STATUS_CRC_FAILED,
+    OWB_STATUS_TOO_MANY_BITS,
+    OWB_STATUS_HW_ERROR,
+} owb_status;
+typedef union
+{
+    struct
+    {
+        uint8_t family[1];
+        uint8_t serial_number[6];
+        uint8_t crc[1];
+    } fields;
+    uint8_t bytes[8];
+} OneWireBus_ROMCode;
+typedef struct
+{
+    OneWireBus_ROMCode rom_code;
+    int last_discrepancy;
+    int last_family_discrepancy;
+    int last_device_flag;
+} OneWireBus_SearchState;
+struct owb_driver;
+typedef struct
+{
+    const void *timing;
+    bool use_crc;
+    bool use_parasitic_power;
+    gpio_num_t strong_pullup_gpio;
+    const struct owb_driver *driver;
+} OneWireBus;
+#define OWB_ROM_CODE_STRING_LENGTH 17
+owb_status owb_use_crc(const OneWireBus *bus, bool use_crc);
+owb_status owb_use_parasitic_power(const OneWireBus *bus, bool use_parasitic_power);
+owb_status owb_uninitialize(const OneWireBus *bus);
+owb_status owb_reset(const OneWireBus *bus, bool *present);
+owb_status owb_read_rom(const OneWireBus *bus, OneWireBus_ROMCode *rom_code);
+owb_status owb_search_first(const OneWireBus *bus, OneWireBus_SearchState *state, bool *found);
+owb_status owb_search_next(const OneWireBus *bus, OneWireBus_SearchState *state, bool *found);
+owb_status owb_verify_rom(const OneWireBus *bus, OneWireBus_ROMCode rom_code, bool *present);
+char *owb_string_from_rom_code(OneWireBus_ROMCode rom_code, char *buffer, size_t len);
+#include "owb_rmt.h"
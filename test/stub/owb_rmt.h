@@ -0,0 +1,14 @@
+// host stand-in for the esp32-owb header, declaring only what test/ram_budget.sh compiles against
+#pragma once
+#include "owb.h"
+typedef int rmt_channel_t;
+#define RMT_CHANNEL_0 0
+#define RMT_CHANNEL_1 1
+typedef struct
+{
+    OneWireBus bus;
+    int tx_channel;
+    int rx_channel;
+    gpio_num_t gpio;
+} owb_rmt_driver_info;
+OneWireBus *owb_rmt_initialize(owb_rmt_driver_info *info, gpio_num_t gpio, rmt_channel_t tx, rmt_channel_t rx);